@@ -3,23 +3,109 @@
 #include "i2c.h"
 
 #define SI570_I2C_ADDR  0x55
+// output range reachable with HS_DIV 4..11, N1 1..128 and DCO in limits
+#define fOutMinHz 3445000UL     // fDCOMinkHz / (11 * 128), rounded up
+#define fOutMaxHz 1417500000UL  // fDCOMaxkHz / 4
 
 void Si570::setup(uint32_t calibration_frequency)
 {
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_SETUP, 1, calibration_frequency));
   i2c_init();
-  out_calibrate_freq();
+  recall();
   delay(20);
-  read_si570();
-  freq_xtal = (unsigned long) ((uint64_t) calibration_frequency * getHSDIV() * getN1() * (1L << 28) / getRFREQ());
+  freq_xtal = 0;
+  // no chip - set_freq always fail
+  if (read_si570())
+    freq_xtal = (unsigned long) ((uint64_t) calibration_frequency * getHSDIV() * getN1() * (1L << 28) / getRFREQ());
+  xtal_nominal = freq_xtal;
+}
+
+bool Si570::correct_ppb(int32_t ppb)
+{
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_PPB, 1, ppb));
+  if (!xtal_nominal) return false;
+  freq_xtal = xtal_nominal + (int32_t)((int64_t)xtal_nominal * ppb / 1000000000);
+  if (!frequency) return true;
+  // DCO freq is the same, so it is always a smooth RFREQ update
+  setRFREQ(frequency);
+  if (!qwrite_si570()) {
+    f_center = frequency = 0;
+    max_delta = 0;
+    span_active = false;
+    return false;
+  }
+  return true;
+}
+
+bool Si570::set_tuning_span(uint32_t lo, uint32_t hi)
+{
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_SPAN, 2, lo, hi));
+  span_lo = span_hi = 0;
+  span_active = false;
+  if (!lo) return true;
+  if (lo > hi) {
+    uint32_t t = lo;
+    lo = hi;
+    hi = t;
+  }
+  // findDivisors works in kHz, keep lo/1000 non zero
+  if (lo < fOutMinHz || hi > fOutMaxHz) return false;
+  uint32_t center = lo + (hi - lo) / 2;
+  uint32_t delta = ((uint64_t) center * 10035LL / 10000LL) - center;
+  if (hi - center >= delta) return false;
+  // divisors valid for DCO at both ends
+  uint16_t save_hs = hs, save_n1 = n1;
+  bool ok = findDivisors(lo, hi);
+  span_hs = ok ? hs : 0;
+  span_n1 = ok ? n1 : 0;
+  hs = save_hs;
+  n1 = save_n1;
+  if (!ok) return false;
+  span_lo = lo;
+  span_hi = hi;
+  return true;
+}
+
+bool Si570::recenter(uint32_t newfreq)
+{
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_RECENTER, 1, newfreq));
+  if (!freq_xtal) return false;
+  // span divisors keep DCO in range, but window is centered on newfreq
+  if (in_span(newfreq)) {
+    hs = span_hs;
+    n1 = span_n1;
+  } else if (!findDivisors(newfreq, newfreq)) return false;
+  return jump(newfreq);
+}
+
+void Si570::set_retry(uint8_t count, uint16_t backoff_us)
+{
+  retry_count = count;
+  retry_backoff_us = backoff_us;
+}
+
+bool Si570::retry(uint8_t attempt, uint16_t* backoff)
+{
+  if (attempt >= retry_count) return false;
+  delayMicroseconds(*backoff);
+  if (*backoff < 0x8000) *backoff <<= 1;
+  return true;
 }
 
 void Si570::out_calibrate_freq()
+{
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_CALIBRATE, 0));
+  recall();
+}
+
+void Si570::recall()
 {
   // Force Si570 to reset to initial freq
   i2c_write_reg(135,0x01);
   // We are about the reset the Si570, so set the current and center frequency to the calibration frequency.
   f_center = frequency = 0;
   max_delta = 0;
+  span_active = false;
 }
 
 // Return the 8 bit HSDIV value from register 7
@@ -49,101 +135,127 @@ uint64_t Si570::getRFREQ()
 }
 
 // Write a byte to I2C device
-void Si570::i2c_write_reg(uint8_t reg_address, uint8_t data)
+bool Si570::i2c_write_reg(uint8_t reg_address, uint8_t data)
 {
-  i2c_begin_write(SI570_I2C_ADDR);
-  i2c_write(reg_address);
-  i2c_write(data);
-  i2c_end();
+  return i2c_write_reg(reg_address, &data, 1);
 }
 
-// Write length bytes to I2C device.
-void Si570::i2c_write_reg(uint8_t reg_address, uint8_t *data, uint8_t length)
+// Write length bytes to I2C device. Stop on first NAK and retry, return false on fail
+bool Si570::i2c_write_reg(uint8_t reg_address, uint8_t *data, uint8_t length)
 {
-  i2c_begin_write(SI570_I2C_ADDR);
-  i2c_write(reg_address);
-  while (length-- > 0)
-    i2c_write(*data++);
-  i2c_end();
+  uint16_t backoff = retry_backoff_us;
+  for (uint8_t attempt=0; ; attempt++) {
+    I2C_STAT(uint32_t t = micros());
+    uint8_t sent = 0;
+    bool ok = i2c_begin_write(SI570_I2C_ADDR) && i2c_write(reg_address);
+    while (ok && sent < length)
+      ok = i2c_write(data[sent++]);
+    if (!i2c_end()) ok = false;
+    I2C_STAT(stat_xfer(t, reg_address, data, sent, ok ? I2C_TRACE_WRITE : I2C_TRACE_NAK));
+    if (ok) return true;
+    if (!retry(attempt, &backoff)) return false;
+  }
 }
 
-// Read a one byte register from the I2C device
-uint8_t Si570::i2c_read_reg(uint8_t reg_address) 
+// Read multiple bytes fromt he I2C device. Return 0 on NAK
+int Si570::i2c_read_reg(uint8_t reg_address, uint8_t *output, uint8_t length) 
 {
-  i2c_begin_write(SI570_I2C_ADDR);
-  i2c_write(reg_address);
-  i2c_begin_read(SI570_I2C_ADDR);
-  uint8_t data = i2c_read();
-  i2c_end();
-  return data;
+  uint16_t backoff = retry_backoff_us;
+  for (uint8_t attempt=0; ; attempt++) {
+    I2C_STAT(uint32_t t = micros());
+    bool ok = i2c_begin_write(SI570_I2C_ADDR) && i2c_write(reg_address) && i2c_begin_read(SI570_I2C_ADDR);
+    if (ok) i2c_read(output,length);
+    if (!i2c_end()) ok = false;
+    I2C_STAT(stat_xfer(t, reg_address, output, ok ? length : 0, I2C_TRACE_READ | (ok ? 0 : I2C_TRACE_NAK)));
+    if (ok) return length;
+    if (!retry(attempt, &backoff)) return 0;
+  }
 }
 
-// Read multiple bytes fromt he I2C device
-int Si570::i2c_read_reg(uint8_t reg_address, uint8_t *output, uint8_t length) 
+#ifdef I2C_STATS
+void Si570::stat_xfer(uint32_t start, uint8_t reg_address, const uint8_t *data, uint8_t length, uint8_t flags)
 {
-  i2c_begin_write(SI570_I2C_ADDR);
-  i2c_write(reg_address);
-  i2c_begin_read(SI570_I2C_ADDR);
-  i2c_read(output,length);
-  i2c_end();
-  return length;
+  stats.bus_us += micros() - start;
+  stats.transactions++;
+  stats.bytes += length+1;
+  if (flags & I2C_TRACE_NAK) stats.naks++;
+  if (trace) {
+    uint8_t buf[8];
+    buf[0] = reg_address;
+    if (length > 7) length = 7;
+    for (uint8_t i=0; i < length; i++) buf[i+1] = data[i];
+    trace(SI570_I2C_ADDR, buf, length+1, flags);
+  }
 }
+#endif
 
 // Read the Si570 chip and populate dco_reg values
 bool Si570::read_si570()
 {
-  i2c_read_reg(7, &(dco_reg[0]), 6);
-  return true;
+  return i2c_read_reg(7, &(dco_reg[0]), 6) != 0;
 }
 
 // Write dco_reg values to the Si570
-void Si570::write_si570()
+// on error DCO stay frozen on previous freq
+bool Si570::write_si570()
 {
-  int idco;
+  uint8_t idco;
 
   // Freeze DCO
-  idco = i2c_read_reg(137);
-  i2c_write_reg(137, idco | 0x10 );
+  if (!i2c_read_reg(137, &idco, 1)) return false;
+  if (!i2c_write_reg(137, idco | 0x10 )) return false;
 
-  i2c_write_reg(7, &dco_reg[0], 6);
+  if (!i2c_write_reg(7, &dco_reg[0], 6)) return false;
 
   // Unfreeze DCO
-  i2c_write_reg(137, idco & 0xEF);
+  if (!i2c_write_reg(137, idco & 0xEF)) return false;
 
   // Set new freq
-  i2c_write_reg(135,0x40);
+  if (!i2c_write_reg(135,0x40)) return false;
+  I2C_STAT(stats.pll_resets++);
+  return true;
 }
 
 // In the case of a frequency change < 3500 ppm, only RFREQ must change
-void Si570::qwrite_si570()
+bool Si570::qwrite_si570()
 {
-  int idco;
+  uint8_t idco;
 
   // Freeze the M Control Word to prevent interim frequency changes when writing RFREQ registers.
-  idco = i2c_read_reg(135);
-  i2c_write_reg(135, idco | 0x20);
+  if (!i2c_read_reg(135, &idco, 1)) return false;
+  if (!i2c_write_reg(135, idco | 0x20)) return false;
 
   // Write RFREQ registers
-  i2c_write_reg(7, &dco_reg[0], 6);
+  if (!i2c_write_reg(7, &dco_reg[0], 6)) return false;
 
   // Unfreeze the M Control Word
-  i2c_write_reg(135, idco &  0xdf);
+  return i2c_write_reg(135, idco &  0xdf);
 }
 
 #define fDCOMinkHz 4850000	// Minimum DCO frequency in kHz
 #define fDCOMaxkHz 5670000  // Maximum DCO frequency in KHz
 
+// inside a span set by set_tuning_span
+bool Si570::in_span(uint32_t f)
+{
+  return span_hs && f >= span_lo && f <= span_hi;
+}
+
 // Locate an appropriate set of divisors (HSDiv and N1) give a desired output frequency
-bool Si570::findDivisors(uint32_t fout)
+// range, DCO must stay in limits from lo to hi
+bool Si570::findDivisors(uint32_t lo, uint32_t hi)
 {
   const uint16_t HS_DIV[] = {11, 9, 7, 6, 5, 4};
-  uint32_t fout_kHz = fout / 1000;
+  // also keeps the kHz divisions below away from 0
+  if (lo < fOutMinHz || hi > fOutMaxHz) return false;
+  uint32_t lo_kHz = lo / 1000;
 
   // Floor of the division
-  uint16_t maxDivider = fDCOMaxkHz / fout_kHz;
- 
+  uint16_t maxDivider = fDCOMaxkHz / (hi / 1000);
   // Ceiling of the division
-  n1 = 1 + ((fDCOMinkHz - 1) / fout_kHz / 11);
+  uint16_t minDivider = 1 + (fDCOMinkHz - 1) / lo_kHz;
+
+  n1 = 1 + ((fDCOMinkHz - 1) / lo_kHz / 11);
 
   if (n1 < 1 || n1 > 128)
     return false;
@@ -156,8 +268,11 @@ bool Si570::findDivisors(uint32_t fout)
       for (int i = 0; i < 6 ; ++i) 
       {
         hs = HS_DIV[i];
-        if (hs * n1 <= maxDivider) 
-          return true;
+        if (hs * n1 <= maxDivider) {
+          if (hs * n1 >= minDivider) return true;
+          // smaller hs is below DCO min too, try next n1
+          break;
+        }
       }
     }
     n1++;
@@ -190,28 +305,70 @@ void Si570::setRFREQ(uint32_t fnew)
   dco_reg[1] |= ((n1-1) & 0x3) << 6;
 }
 
+// full write with current hs/n1, DCO restart. center of new 3500 ppm window
+bool Si570::jump(uint32_t center)
+{
+  setRFREQ(center);
+  span_active = false;
+  if (!write_si570()) {
+    f_center = frequency = 0;
+    max_delta = 0;
+    return false;
+  }
+  frequency = f_center = center;
+  // Calculate the new 3500 ppm delta
+  max_delta = ((uint64_t) f_center * 10035LL / 10000LL) - f_center;
+  I2C_STAT(stats.slow_tunes++);
+  return true;
+}
+
+// RFREQ only update inside current window
+bool Si570::smooth(uint32_t newfreq)
+{
+  setRFREQ(newfreq);
+  if (!qwrite_si570()) {
+    // chip state is unknown, full write on next call
+    f_center = frequency = 0;
+    max_delta = 0;
+    span_active = false;
+    return false;
+  }
+  frequency = newfreq;
+  I2C_STAT(stats.fast_tunes++);
+  return true;
+}
+
 // Set the Si570 frequency
 bool Si570::set_freq(uint32_t newfreq) 
 {
+  I2C_STAT(i2c_trace_call(trace, SI570_I2C_ADDR, I2C_CALL_FREQ, 1, newfreq));
+  if (!freq_xtal) return false;
   // If the current frequency has not changed, we are done
   if (frequency != newfreq) {
+    I2C_STAT(uint32_t t = micros());
+    I2C_STAT(uint32_t bus = stats.bus_us);
     // Check how far we have moved the frequency (without using abs() function)
     uint32_t delta_freq = newfreq < f_center ? f_center - newfreq : newfreq - f_center;
   
-    // If the jump is small enough, we don't have to fiddle with the dividers
-    if (delta_freq < max_delta) {
-      setRFREQ(newfreq);
-      frequency = newfreq;
-      qwrite_si570();
+    bool span = in_span(newfreq);
+  
+    // If the jump is small enough, we don't have to fiddle with the dividers.
+    // whole planned span is one window once entered
+    if ((span && span_active) || delta_freq < max_delta) {
+      if (!smooth(newfreq)) return false;
+    } else if (span) {
+      // enter span: DCO restart at its center, then RFREQ step to newfreq
+      hs = span_hs;
+      n1 = span_n1;
+      if (!jump(span_lo + (span_hi - span_lo) / 2)) return false;
+      span_active = true;
+      if (frequency != newfreq && !smooth(newfreq)) return false;
     } else {
       // otherwise it is a big jump and we need a new set of divisors and reset center frequency
-      if (!findDivisors(newfreq)) return false;
-      setRFREQ(newfreq);
-      f_center = frequency = newfreq;
-  	  // Calculate the new 3500 ppm delta
-  	  max_delta = ((uint64_t) f_center * 10035LL / 10000LL) - f_center;
-      write_si570();
+      if (!findDivisors(newfreq, newfreq)) return false;
+      if (!jump(newfreq)) return false;
     }
+    I2C_STAT(stats.compute_us += (micros() - t) - (stats.bus_us - bus));
   }
   return true;
 }
@@ -12,6 +12,9 @@
 #ifndef SI570_H
 #define SI570_H
 
+#include <inttypes.h>
+#include "i2c_stats.h"
+
 class Si570
 {
 public:
@@ -19,37 +22,72 @@ public:
   
   void setup(uint32_t calibration_frequency);
 
-  // in Hz
+  // in Hz. return false if chip not respond, next call do full write
   bool set_freq(uint32_t newfreq);
 
+  // on NAK repeat transfer up to count times, delay doubles from backoff_us
+  // default - no retry
+  void set_retry(uint8_t count, uint16_t backoff_us);
+
   void out_calibrate_freq();
 
+  // xtal drift correction relative to setup() calibration, in ppb.
+  // RFREQ only update of current freq, no DCO restart
+  bool correct_ppb(int32_t ppb);
+
+  // plan one DCO window (HS_DIV/N1, center) covering lo..hi, e.g. whole band.
+  // inside the span set_freq never restarts DCO except first entry.
+  // return false if span is wider than +-3500 ppm, out of output range
+  // (about 3.45..1417 MHz) or DCO range. lo=0 - off
+  bool set_tuning_span(uint32_t lo, uint32_t hi);
+  // full write (DCO restart) at freq, new +-3500 ppm window centered there.
+  // inside a span keeps span divisors; next tune out of window re-enters span
+  bool recenter(uint32_t newfreq);
+
+#ifdef I2C_STATS
+  I2CStats stats = {};
+  I2CTraceHook trace = 0;
+#endif
+
 private:
   uint8_t dco_reg[6];
   uint32_t f_center;
   uint32_t frequency;
   uint16_t hs, n1;
   uint32_t freq_xtal;
+  uint32_t xtal_nominal = 0;
   uint64_t fdco;
   uint64_t rfreq;
   uint32_t max_delta;
+  uint32_t span_lo = 0, span_hi = 0;
+  uint16_t span_hs = 0, span_n1 = 0; // 0 - no span
+  bool span_active = false; // current hs/n1/f_center is span plan
+  uint8_t retry_count = 0;
+  uint16_t retry_backoff_us = 0;
 
-  uint8_t i2c_read_reg(uint8_t reg_address);
+  bool retry(uint8_t attempt, uint16_t* backoff);
   int i2c_read_reg(uint8_t reg_address, uint8_t *output, uint8_t length);
 
-  void i2c_write_reg(uint8_t reg_address, uint8_t data);
-  void i2c_write_reg(uint8_t reg_address, uint8_t *data, uint8_t length);
+  bool i2c_write_reg(uint8_t reg_address, uint8_t data);
+  bool i2c_write_reg(uint8_t reg_address, uint8_t *data, uint8_t length);
+#ifdef I2C_STATS
+  void stat_xfer(uint32_t start, uint8_t reg_address, const uint8_t *data, uint8_t length, uint8_t flags);
+#endif
 
+  void recall();
   bool read_si570();
-  void write_si570();
-  void qwrite_si570();
+  bool write_si570();
+  bool qwrite_si570();
+  bool jump(uint32_t center);
+  bool smooth(uint32_t newfreq);
 
   uint8_t getHSDIV();
   uint8_t getN1();
   uint64_t getRFREQ();
 
   void setRFREQ(uint32_t fnew);
-  bool findDivisors(uint32_t f);
+  bool findDivisors(uint32_t lo, uint32_t hi);
+  bool in_span(uint32_t f);
 };
 
 #endif
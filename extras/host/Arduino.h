@@ -0,0 +1,79 @@
+// minimal Arduino API for building the library on a host PC
+// time is virtual: delay()/delayMicroseconds() and the I2C stand-in
+// advance the clock, micros()/millis() read it. clock is per thread
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW  0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+
+#define SDA 18
+#define SCL 19
+
+#define PROGMEM
+#define pgm_read_byte(addr)  (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define memcpy_P memcpy
+
+typedef uint8_t byte;
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// virtual clock in ns
+uint64_t host_time_ns();
+void host_advance_ns(uint64_t ns);
+// cost of one pinMode/digitalWrite/digitalRead call, default 0
+void host_set_pin_ns(uint32_t ns);
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char* s) { size_t n = 0; while (*s) n += write((uint8_t)*s++); return n; }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t println() { return write((uint8_t)'\n'); }
+    template <class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <class T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+};
+
+// writes to stdout
+class HostSerial: public Print {
+  public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
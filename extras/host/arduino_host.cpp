@@ -0,0 +1,63 @@
+// minimal Arduino API for building the library on a host PC
+// Print and Serial are in print_host.cpp
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include "Arduino.h"
+
+static thread_local uint64_t time_ns = 0;
+static thread_local uint32_t pin_ns = 0;
+
+uint64_t host_time_ns()
+{
+  return time_ns;
+}
+
+void host_advance_ns(uint64_t ns)
+{
+  time_ns += ns;
+}
+
+void host_set_pin_ns(uint32_t ns)
+{
+  pin_ns = ns;
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(time_ns / 1000);
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(time_ns / 1000000);
+}
+
+void delay(unsigned long ms)
+{
+  time_ns += (uint64_t)ms * 1000000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  time_ns += (uint64_t)us * 1000;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+  time_ns += pin_ns;
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+  time_ns += pin_ns;
+}
+
+int digitalRead(uint8_t)
+{
+  // lines are released high, slave always drives ACK
+  time_ns += pin_ns;
+  return LOW;
+}
@@ -0,0 +1,170 @@
+// host stand-in for the i2c.h API
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <Arduino.h>
+#include "i2c_host.h"
+
+struct HostI2CState {
+  uint8_t regs[128][256];
+  bool absent[128];
+  std::vector<HostI2CTransfer> log;
+  HostI2CTransfer cur;
+  bool open;
+  uint8_t ptr;
+  uint32_t bit_ns;   // 0 - no wire time
+  uint32_t gap_ns;   // master overhead between bytes
+};
+
+static thread_local HostI2CState* state = 0;
+
+static HostI2CState& bus()
+{
+  if (!state) {
+    state = new HostI2CState();
+    memset(state->regs, 0, sizeof(state->regs));
+    memset(state->absent, 0, sizeof(state->absent));
+    state->open = false;
+    state->ptr = 0;
+    state->bit_ns = 0;
+    state->gap_ns = 0;
+  }
+  return *state;
+}
+
+std::vector<HostI2CTransfer>& host_i2c_log()
+{
+  return bus().log;
+}
+
+void host_i2c_clear_log()
+{
+  bus().log.clear();
+}
+
+uint8_t* host_i2c_regs(uint8_t addr)
+{
+  return bus().regs[addr & 0x7F];
+}
+
+void host_i2c_set_present(uint8_t addr, bool present)
+{
+  bus().absent[addr & 0x7F] = !present;
+}
+
+void host_i2c_set_clock(uint32_t scl_hz, uint32_t byte_gap_ns)
+{
+  HostI2CState& b = bus();
+  b.bit_ns = scl_hz ? 1000000000 / scl_hz : 0;
+  b.gap_ns = byte_gap_ns;
+}
+
+// START, repeated START and STOP take one SCL period
+static void wire_cond()
+{
+  host_advance_ns(bus().bit_ns);
+}
+
+// 8 data bits + ACK
+static void wire_byte()
+{
+  HostI2CState& b = bus();
+  host_advance_ns(9 * b.bit_ns + b.gap_ns);
+}
+
+// same clamp as TWI driver
+void i2c_init(uint32_t i2c_freq)
+{
+  if (i2c_freq < 100000) i2c_freq = 100000;
+  host_i2c_set_clock(i2c_freq, bus().gap_ns);
+}
+
+bool i2c_begin_write(uint8_t addr)
+{
+  HostI2CState& b = bus();
+  if (b.open) i2c_end();
+  b.cur.addr = addr & 0x7F;
+  b.cur.flags = 0;
+  b.cur.data.clear();
+  b.cur.start_ns = host_time_ns();
+  b.open = true;
+  wire_cond();
+  wire_byte();
+  if (b.absent[b.cur.addr]) {
+    b.cur.flags |= I2C_TRACE_NAK;
+    return false;
+  }
+  return true;
+}
+
+bool i2c_begin_read(uint8_t addr)
+{
+  HostI2CState& b = bus();
+  // repeated start after register address continues the same transfer
+  if (!b.open || b.cur.addr != (addr & 0x7F) || b.cur.data.size() != 1) {
+    i2c_begin_write(addr);
+  } else {
+    wire_cond();
+    wire_byte();
+  }
+  b.cur.flags |= I2C_TRACE_READ;
+  return !(b.cur.flags & I2C_TRACE_NAK);
+}
+
+bool i2c_write(uint8_t data)
+{
+  HostI2CState& b = bus();
+  if (!b.open || (b.cur.flags & I2C_TRACE_NAK)) return false;
+  wire_byte();
+  if (b.cur.data.empty())
+    b.ptr = data;
+  else
+    b.regs[b.cur.addr][b.ptr++] = data;
+  b.cur.data.push_back(data);
+  return true;
+}
+
+uint8_t i2c_read_continue(bool)
+{
+  HostI2CState& b = bus();
+  if (!b.open || (b.cur.flags & I2C_TRACE_NAK)) return 0xFF;
+  wire_byte();
+  uint8_t data = b.regs[b.cur.addr][b.ptr++];
+  b.cur.data.push_back(data);
+  return data;
+}
+
+uint8_t i2c_read()
+{
+  return i2c_read_continue(true);
+}
+
+void i2c_read(uint8_t* data, uint8_t count)
+{
+  while (count--) *data++ = i2c_read_continue(count == 0);
+}
+
+void i2c_read_long(uint8_t* data, uint16_t count)
+{
+  while (count--) *data++ = i2c_read_continue(count == 0);
+}
+
+bool i2c_end()
+{
+  HostI2CState& b = bus();
+  if (!b.open) return true;
+  wire_cond();
+  b.cur.end_ns = host_time_ns();
+  b.log.push_back(b.cur);
+  b.open = false;
+  return !(b.cur.flags & I2C_TRACE_NAK);
+}
+
+bool i2c_device_found(uint8_t addr)
+{
+  bool found = i2c_begin_write(addr);
+  i2c_end();
+  return found;
+}
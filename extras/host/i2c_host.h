@@ -0,0 +1,37 @@
+// host stand-in for the i2c.h API
+// keeps a 256 byte register file per slave address and logs every transaction
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef I2C_HOST_H
+#define I2C_HOST_H
+
+#include <inttypes.h>
+#include <vector>
+#include "../../i2c.h"
+
+struct HostI2CTransfer {
+  uint8_t addr;
+  uint8_t flags;              // I2C_TRACE_READ, I2C_TRACE_NAK
+  std::vector<uint8_t> data;  // register, then payload
+  uint64_t start_ns, end_ns;  // virtual clock
+};
+
+// transactions since last clear. state is per thread
+std::vector<HostI2CTransfer>& host_i2c_log();
+void host_i2c_clear_log();
+
+// register file of slave
+uint8_t* host_i2c_regs(uint8_t addr);
+
+// absent slave NAKs its address. all slaves present by default
+void host_i2c_set_present(uint8_t addr, bool present);
+
+// wire time on virtual clock: START, Sr and STOP - 1 SCL period,
+// byte - 9 periods + byte_gap_ns of master overhead.
+// i2c_init() sets SCL like the TWI driver, scl_hz = 0 - transfers take no time
+void host_i2c_set_clock(uint32_t scl_hz, uint32_t byte_gap_ns = 0);
+
+#endif
@@ -0,0 +1,338 @@
+// replay of i2c_recorder dump through the current driver
+// every API call record is executed on host Si5351/Si570, the produced I2C
+// transactions are compared with the captured ones.
+// sweep over a list records only its ends, comparison stops there.
+// driver state is rebuilt from the calls, so the capture must start with
+// setup()/set_xtal_freq() of each chip: a wrapped capture ("# lost") or one
+// cleared mid-session is refused, -f replays it anyway
+//
+// build (from this directory):
+//   g++ -O2 -I. -o i2c_replay i2c_replay.cpp i2c_host.cpp arduino_host.cpp print_host.cpp
+//       ../../si5351a.cpp ../../Si570.cpp ../../i2c_soft.cpp
+// usage:
+//   i2c_replay [-v] [-f] capture.txt
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "i2c_host.h"
+#include "../../si5351a.h"
+#include "../../Si570.h"
+#include "../../si5351_plan.h"
+
+#define SI5351_ADDR 0x60
+#define SI570_ADDR  0x55
+
+struct Record {
+  uint32_t line;
+  uint8_t addr;
+  uint8_t flags;
+  std::vector<uint8_t> data;
+};
+
+static bool parse_line(const char* s, Record& r)
+{
+  char* end;
+  strtoul(s, &end, 10); // time, not used
+  if (end == s) return false;
+  r.addr = strtoul(end, &end, 16);
+  while (*end == ' ') end++;
+  switch (*end++) {
+    case 'W': r.flags = I2C_TRACE_WRITE; break;
+    case 'R': r.flags = I2C_TRACE_READ; break;
+    case 'C': r.flags = I2C_TRACE_CALL; break;
+    default: return false;
+  }
+  if (*end == '!') {
+    r.flags |= I2C_TRACE_NAK;
+    end++;
+  }
+  r.data.clear();
+  for (;;) {
+    char* p = end;
+    unsigned long v = strtoul(p, &end, 16);
+    if (end == p) break;
+    r.data.push_back(v);
+  }
+  return true;
+}
+
+static uint32_t arg(const Record& call, uint8_t idx)
+{
+  uint32_t v = 0;
+  for (uint8_t i=0; i < 4; i++) {
+    size_t pos = 1 + idx*4 + i;
+    if (pos < call.data.size()) v |= (uint32_t)call.data[pos] << (8*i);
+  }
+  return v;
+}
+
+// int32 arguments: ppb, sweep step, modulation sample
+static bool signed_arg(uint8_t op, uint8_t idx)
+{
+  return (op == I2C_CALL_PPB && idx == 0) || (op == I2C_CALL_SWEEP && idx == 2) ||
+    (op == I2C_CALL_MOD_SAMPLE && idx == 0);
+}
+
+static std::string describe(const Record& call)
+{
+  char buf[96];
+  uint8_t argc = (call.data.size()-1) / 4;
+  const char* name = "?";
+  switch (call.data[0]) {
+    case I2C_CALL_SETUP: name = "setup"; break;
+    case I2C_CALL_XTAL: name = "set_xtal_freq"; break;
+    case I2C_CALL_POWER: name = "set_power"; break;
+    case I2C_CALL_FREQ: name = "set_freq"; break;
+    case I2C_CALL_QUAD: name = "set_freq_quadrature"; break;
+    case I2C_CALL_CALIBRATE: name = "out_calibrate_freq"; break;
+    case I2C_CALL_OUTPUTS: name = "set_outputs"; break;
+    case I2C_CALL_PPB: name = "correct_ppb"; break;
+    case I2C_CALL_PLAN: name = "apply_plan"; break;
+    case I2C_CALL_SWEEP: name = "sweep"; break;
+    case I2C_CALL_SWEEP_STOP: name = "sweep stopped"; break;
+    case I2C_CALL_SWEEP_LIST: name = "sweep(list)"; break;
+    case I2C_CALL_MOD_BEGIN: name = "mod_begin"; break;
+    case I2C_CALL_MOD_SAMPLE: name = "mod_sample"; break;
+    case I2C_CALL_MOD_END: name = "mod_end"; break;
+    case I2C_CALL_RESET_DEFER: name = "set_reset_defer"; break;
+    case I2C_CALL_FLUSH_RESET: name = "flush_reset"; break;
+    case I2C_CALL_QUANTUM: name = "set_tuning_quantum"; break;
+    case I2C_CALL_PINGPONG: name = "set_freq_pingpong"; break;
+    case I2C_CALL_PINGPONG_PREPARE: name = "prepare_pingpong"; break;
+    case I2C_CALL_RECENTER: name = "recenter"; break;
+    case I2C_CALL_SPAN: name = "set_tuning_span"; break;
+  }
+  int n = snprintf(buf, sizeof(buf), "%02X %s(", call.addr, name);
+  for (uint8_t i=0; i < argc; i++) {
+    if (i) n += snprintf(buf+n, sizeof(buf)-n, ",");
+    if (signed_arg(call.data[0], i))
+      n += snprintf(buf+n, sizeof(buf)-n, "%ld", (long)(int32_t)arg(call, i));
+    else
+      n += snprintf(buf+n, sizeof(buf)-n, "%lu", (unsigned long)arg(call, i));
+  }
+  snprintf(buf+n, sizeof(buf)-n, ")");
+  return buf;
+}
+
+// points to pass in replayed sweep, from SWEEP_STOP record
+static uint16_t sweep_limit;
+
+static bool replay_dwell(uint16_t index, uint32_t)
+{
+  return index+1 < sweep_limit;
+}
+
+// next - following call record or 0
+static bool execute(Si5351& si5351, Si570& si570, const Record& call, const Record* next)
+{
+  uint8_t argc = (call.data.size()-1) / 4;
+  if (call.addr == SI5351_ADDR) {
+    switch (call.data[0]) {
+      case I2C_CALL_OUTPUTS: si5351.set_outputs(arg(call,0)); return true;
+      case I2C_CALL_PPB: si5351.correct_ppb((int32_t)arg(call,0)); return true;
+      case I2C_CALL_PLAN: {
+        Si5351Plan plan = si5351_plan::make(arg(call,0) & 0xFF, arg(call,2), arg(call,1), arg(call,0) >> 8);
+        si5351.apply_plan(&plan);
+        return true;
+      }
+      case I2C_CALL_SWEEP: {
+        uint16_t count = arg(call,0) >> 8;
+        uint32_t start = arg(call,1);
+        int32_t step = arg(call,2);
+        // stop that gives sweep() the same count and direction
+        uint32_t stop = start + step * (int32_t)(count - 1);
+        if (count == 1 && step > 0) stop = start + step - 1;
+        sweep_limit = count;
+        if (next && next->addr == call.addr && next->data.size() > 1 && next->data[0] == I2C_CALL_SWEEP_STOP)
+          sweep_limit = arg(*next,0);
+        si5351.sweep(arg(call,0) & 0xFF, start, stop, step < 0 ? -step : step, replay_dwell);
+        return true;
+      }
+      // no bus traffic of its own, read by I2C_CALL_SWEEP
+      case I2C_CALL_SWEEP_STOP: return true;
+      case I2C_CALL_RESET_DEFER: si5351.set_reset_defer(arg(call,0)); return true;
+      case I2C_CALL_FLUSH_RESET: si5351.flush_reset(); return true;
+      case I2C_CALL_QUANTUM: si5351.set_tuning_quantum(arg(call,0)); return true;
+#ifndef SI5351_NO_MODULATION
+      case I2C_CALL_MOD_BEGIN: si5351.mod_begin(arg(call,0), arg(call,1)); return true;
+      case I2C_CALL_MOD_SAMPLE: si5351.mod_sample((int8_t)arg(call,0)); return true;
+      case I2C_CALL_MOD_END: si5351.mod_end(); return true;
+#endif
+#ifndef SI5351_NO_PINGPONG
+      case I2C_CALL_PINGPONG: si5351.set_freq_pingpong(arg(call,0), arg(call,1)); return true;
+      case I2C_CALL_PINGPONG_PREPARE: si5351.prepare_pingpong(arg(call,0)); return true;
+#endif
+      case I2C_CALL_SETUP: si5351.setup(arg(call,0), arg(call,1), arg(call,2)); return true;
+      case I2C_CALL_XTAL: si5351.set_xtal_freq(arg(call,0)); return true;
+      case I2C_CALL_POWER: si5351.set_power(arg(call,0), arg(call,1)); return true;
+      case I2C_CALL_QUAD: si5351.set_freq_quadrature(arg(call,0), arg(call,1), arg(call,2)); return true;
+      case I2C_CALL_CALIBRATE: si5351.out_calibrate_freq(); return true;
+      case I2C_CALL_FREQ:
+        if (argc == 1) si5351.set_freq(arg(call,0));
+        else if (argc == 2) si5351.set_freq(arg(call,0), arg(call,1));
+        else si5351.set_freq(arg(call,0), arg(call,1), arg(call,2));
+        return true;
+    }
+  } else if (call.addr == SI570_ADDR) {
+    switch (call.data[0]) {
+      case I2C_CALL_SETUP: si570.setup(arg(call,0)); return true;
+      case I2C_CALL_FREQ: si570.set_freq(arg(call,0)); return true;
+      case I2C_CALL_CALIBRATE: si570.out_calibrate_freq(); return true;
+      case I2C_CALL_PPB: si570.correct_ppb((int32_t)arg(call,0)); return true;
+      case I2C_CALL_RECENTER: si570.recenter(arg(call,0)); return true;
+      case I2C_CALL_SPAN: si570.set_tuning_span(arg(call,0), arg(call,1)); return true;
+    }
+  }
+  return false;
+}
+
+static void print_xfer(const char* prefix, uint8_t addr, uint8_t flags, const std::vector<uint8_t>& data)
+{
+  printf("%s%02X %c%s", prefix, addr, flags & I2C_TRACE_READ ? 'R' : 'W', flags & I2C_TRACE_NAK ? "!" : "");
+  for (size_t i=0; i < data.size(); i++) printf(" %02X", data[i]);
+  printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+  bool verbose = false, force = false;
+  const char* fname = 0;
+  for (int i=1; i < argc; i++) {
+    if (!strcmp(argv[i], "-v")) verbose = true;
+    else if (!strcmp(argv[i], "-f")) force = true;
+    else fname = argv[i];
+  }
+  if (!fname) {
+    fprintf(stderr, "usage: %s [-v] [-f] capture.txt\n", argv[0]);
+    return 2;
+  }
+  FILE* f = fopen(fname, "r");
+  if (!f) {
+    perror(fname);
+    return 2;
+  }
+
+  std::vector<Record> records;
+  char line[256];
+  uint32_t lineno = 0;
+  bool partial = false;
+  while (fgets(line, sizeof(line), f)) {
+    Record r;
+    lineno++;
+    if (line[0] == '#') {
+      if (!strncmp(line, "# lost", 6)) {
+        printf("%s: line %u: recorder wrapped, %s", force ? "warning" : "error", lineno, line+2);
+        partial = true;
+      }
+      continue;
+    }
+    if (!parse_line(line, r)) continue;
+    r.line = lineno;
+    records.push_back(r);
+  }
+  fclose(f);
+
+  Si5351 si5351;
+  Si570 si570;
+  uint32_t calls = 0, diff_calls = 0, skipped = 0;
+  bool stopped = false;
+  uint32_t cap_xfers = 0, cap_bytes = 0, rep_xfers = 0, rep_bytes = 0;
+
+  // first call of each chip must reset driver state
+  bool seen5351 = false, seen570 = false;
+  for (size_t k=0; k < records.size(); k++) {
+    const Record& r = records[k];
+    if (!(r.flags & I2C_TRACE_CALL) || r.data.empty()) continue;
+    bool* seen = r.addr == SI5351_ADDR ? &seen5351 : &seen570;
+    if (*seen) continue;
+    *seen = true;
+    if (r.data[0] != I2C_CALL_SETUP && !(r.addr == SI5351_ADDR && r.data[0] == I2C_CALL_XTAL)) {
+      printf("%s: line %u: %s: capture does not start with setup, driver state unknown\n",
+        force ? "warning" : "error", r.line, describe(r).c_str());
+      partial = true;
+    }
+  }
+  if (partial && !force) {
+    printf("capture is incomplete, raise I2C_RECORDER_SIZE or dump earlier; -f replays anyway\n");
+    return 2;
+  }
+
+  size_t i = 0;
+  // bus traffic before the first call has no cause to replay
+  while (i < records.size() && !(records[i].flags & I2C_TRACE_CALL)) {
+    i++;
+    skipped++;
+  }
+  while (i < records.size()) {
+    const Record& call = records[i++];
+    size_t first = i;
+    while (i < records.size() && !(records[i].flags & I2C_TRACE_CALL)) i++;
+
+    // serve captured read data from the register file
+    for (size_t k=first; k < i; k++) {
+      const Record& r = records[k];
+      if ((r.flags & I2C_TRACE_READ) && r.data.size() > 1)
+        memcpy(host_i2c_regs(r.addr) + r.data[0], &r.data[1], r.data.size()-1);
+    }
+
+    if (!call.data.empty() && call.addr == SI5351_ADDR && call.data[0] == I2C_CALL_SWEEP_LIST) {
+      // chip state after unknown points is unknown too
+      printf("line %u: %s: list is not recorded, cannot replay, comparison stops\n",
+        call.line, describe(call).c_str());
+      stopped = true;
+      break;
+    }
+    host_i2c_clear_log();
+    if (call.data.empty() || !execute(si5351, si570, call, i < records.size() ? &records[i] : 0)) {
+      printf("line %u: unknown call record\n", call.line);
+      continue;
+    }
+    calls++;
+
+    std::vector<HostI2CTransfer>& log = host_i2c_log();
+    bool same = log.size() == i-first;
+    uint32_t cb = 0, rb = 0;
+    for (size_t k=first; k < i; k++) {
+      cb += records[k].data.size();
+      if (same) {
+        const HostI2CTransfer& t = log[k-first];
+        same = t.addr == records[k].addr && t.data == records[k].data &&
+          (t.flags & I2C_TRACE_READ) == (records[k].flags & I2C_TRACE_READ);
+      }
+    }
+    for (size_t k=0; k < log.size(); k++)
+      rb += log[k].data.size();
+    cap_xfers += i-first;
+    cap_bytes += cb;
+    rep_xfers += log.size();
+    rep_bytes += rb;
+
+    if (!same) {
+      diff_calls++;
+      printf("line %u: %s: captured %u/%u, replay %u/%u transactions/bytes\n",
+        call.line, describe(call).c_str(),
+        (unsigned)(i-first), cb, (unsigned)log.size(), rb);
+    }
+    if (!same || verbose) {
+      for (size_t k=first; k < i; k++)
+        print_xfer("  - ", records[k].addr, records[k].flags, records[k].data);
+      for (size_t k=0; k < log.size(); k++)
+        print_xfer("  + ", log[k].addr, log[k].flags, log[k].data);
+    }
+  }
+
+  if (skipped)
+    printf("skipped %u transactions before first call record\n", skipped);
+  printf("%u calls, %u differ\n", calls, diff_calls);
+  printf("captured: %u transactions, %u bytes\n", cap_xfers, cap_bytes);
+  printf("replay:   %u transactions, %u bytes (%+d)\n", rep_xfers, rep_bytes, (int)rep_bytes - (int)cap_bytes);
+  return diff_calls || stopped ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+// frequency planner verification: every point of a grid is tuned on a host
+// Si5351, output frequency is rebuilt from the register file and compared
+// with the requested one. grid is split in blocks over all cores, each
+// thread tunes its blocks upward like a VFO so divider reuse is exercised.
+//
+// modes:
+//   clk0  - set_freq(f), update_freq
+//   clk2  - set_freq(0, bfo, f), update_freq12 fractional CLK2
+//   clk2i - set_freq(0, 0, f), update_freq12 integer CLK2
+//   quad  - set_freq_quadrature(f, 0), update_freq_quad CLK0 and CLK1
+//
+// build (from this directory):
+//   g++ -O2 -pthread -I. -o planner_verify planner_verify.cpp i2c_host.cpp
+//       arduino_host.cpp print_host.cpp ../../si5351a.cpp ../../i2c_soft.cpp
+// usage:
+//   planner_verify [-f from] [-t to] [-s step] [-j threads] [-x xtal] [-b bfo] [mode...]
+//   -s 1 checks every Hz
+//   -b 8867000 by default: PLL_B is bfo * even divider, a round bfo such as
+//      9 MHz can give an integer PLL_B/xtal and skip the fractional PLL_B
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include "i2c_host.h"
+#include "../../si5351a.h"
+
+#define SI5351_ADDR 0x60
+#define BLOCK_POINTS 4096
+
+enum Mode { MODE_CLK0, MODE_CLK2, MODE_CLK2I, MODE_QUAD };
+static const char* mode_names[] = {"clk0", "clk2", "clk2i", "quad"};
+
+// error histogram upper bounds, Hz
+#define HIST_SIZE 7
+static const double hist_limit[HIST_SIZE] = {1e-6, 1e-3, 0.01, 0.1, 1, 10, 1e30};
+static const char* hist_names[HIST_SIZE] = {"exact", "<1 mHz", "<10 mHz", "<0.1 Hz", "<1 Hz", "<10 Hz", ">=10 Hz"};
+
+typedef std::pair<uint32_t, uint32_t> Range;
+
+struct Stats {
+  uint64_t points;
+  uint64_t refused;
+  uint64_t vco_low, vco_high;
+  double max_err;
+  uint32_t max_err_freq;
+  uint64_t hist[HIST_SIZE];
+  double busy_s;  // inside set_freq
+  std::vector<Range> refused_ranges;
+  std::vector<Range> vco_ranges;
+};
+
+struct Config {
+  Mode mode;
+  uint32_t from, to, step;
+  uint32_t xtal, bfo;
+  uint64_t count;
+  std::atomic<uint64_t> next_block;
+};
+
+// multiplier (P1+512+P2/P3)/128 of PLL or multisynth image at regs+base
+static double synth_ratio(const uint8_t* b)
+{
+  uint32_t p3 = ((uint32_t)(b[5] >> 4) << 16) | ((uint32_t)b[0] << 8) | b[1];
+  uint32_t p1 = ((uint32_t)(b[2] & 0x03) << 16) | ((uint32_t)b[3] << 8) | b[4];
+  uint32_t p2 = ((uint32_t)(b[5] & 0x0F) << 16) | ((uint32_t)b[6] << 8) | b[7];
+  return (p1 + 512 + (p3 ? (double)p2 / p3 : 0)) / 128.0;
+}
+
+// output frequency of clk from register file, 0 if powered down
+static double decode_out(const uint8_t* regs, uint8_t clk, uint32_t xtal, double* vco)
+{
+  uint8_t ctrl = regs[16 + clk];
+  if (ctrl & 0x80) return 0;
+  *vco = xtal * synth_ratio(regs + ((ctrl & 0x20) ? 34 : 26));
+  const uint8_t* ms = regs + 42 + 8*clk;
+  double div = (ms[2] & 0x0C) == 0x0C ? 4 : synth_ratio(ms);
+  return *vco / div / (1 << ((ms[2] >> 4) & 0x07));
+}
+
+static void add_range(std::vector<Range>& v, uint32_t f, uint32_t step)
+{
+  if (!v.empty() && v.back().second + step == f) v.back().second = f;
+  else v.push_back(Range(f, f));
+}
+
+static void check_out(Stats& st, const uint8_t* regs, uint8_t clk, uint32_t f, uint32_t xtal, uint32_t step, bool* refused)
+{
+  double vco = 0;
+  double out = decode_out(regs, clk, xtal, &vco);
+  if (out == 0) {
+    *refused = true;
+    return;
+  }
+  if (vco < Si5351Base::VCOFreq_Min || vco > Si5351Base::VCOFreq_Max) {
+    if (vco < Si5351Base::VCOFreq_Min) st.vco_low++;
+    else st.vco_high++;
+    add_range(st.vco_ranges, f, step);
+  }
+  double err = fabs(out - f);
+  if (err > st.max_err) {
+    st.max_err = err;
+    st.max_err_freq = f;
+  }
+  uint8_t h = 0;
+  while (err >= hist_limit[h]) h++;
+  st.hist[h]++;
+}
+
+static void worker(Config* cfg, Stats* st)
+{
+  // shared VCOFreq_Mid is set by main before threads start, setup() here
+  // finds it unchanged and does not write it
+  Si5351 vfo;
+  vfo.set_xtal_freq(cfg->xtal);
+  vfo.setup();
+  const uint8_t* regs = host_i2c_regs(SI5351_ADDR);
+  uint64_t blocks = (cfg->count + BLOCK_POINTS - 1) / BLOCK_POINTS;
+  for (;;) {
+    uint64_t blk = cfg->next_block++;
+    if (blk >= blocks) break;
+    uint64_t end = std::min(cfg->count, (blk+1) * BLOCK_POINTS);
+    for (uint64_t i = blk * BLOCK_POINTS; i < end; i++) {
+      uint32_t f = cfg->from + (uint32_t)(i * cfg->step);
+      std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+      switch (cfg->mode) {
+        case MODE_CLK0:  vfo.set_freq(f); break;
+        case MODE_CLK2:  vfo.set_freq(0, cfg->bfo, f); break;
+        case MODE_CLK2I: vfo.set_freq(0, 0, f); break;
+        case MODE_QUAD:  vfo.set_freq_quadrature(f, 0); break;
+      }
+      st->busy_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+      // host log is not needed, keep memory flat
+      host_i2c_clear_log();
+
+      bool refused = false;
+      switch (cfg->mode) {
+        case MODE_CLK0:
+          check_out(*st, regs, 0, f, cfg->xtal, cfg->step, &refused);
+          break;
+        case MODE_CLK2:
+        case MODE_CLK2I:
+          check_out(*st, regs, 2, f, cfg->xtal, cfg->step, &refused);
+          break;
+        case MODE_QUAD:
+          check_out(*st, regs, 0, f, cfg->xtal, cfg->step, &refused);
+          if (!refused) check_out(*st, regs, 1, f, cfg->xtal, cfg->step, &refused);
+          break;
+      }
+      st->points++;
+      if (refused) {
+        st->refused++;
+        add_range(st->refused_ranges, f, cfg->step);
+      }
+    }
+  }
+}
+
+// blocks come out of threads unordered
+static void merge_ranges(std::vector<Range>& v, uint32_t step)
+{
+  std::sort(v.begin(), v.end());
+  std::vector<Range> out;
+  for (size_t i=0; i < v.size(); i++) {
+    if (!out.empty() && (uint64_t)out.back().second + step >= v[i].first)
+      out.back().second = std::max(out.back().second, v[i].second);
+    else
+      out.push_back(v[i]);
+  }
+  v.swap(out);
+}
+
+static void print_ranges(const char* title, std::vector<Range>& v)
+{
+  if (v.empty()) return;
+  printf("  %s:", title);
+  for (size_t i=0; i < v.size() && i < 16; i++)
+    printf(" %u-%u", v[i].first, v[i].second);
+  if (v.size() > 16) printf(" ... (%zu ranges)", v.size());
+  printf("\n");
+}
+
+static void run(Mode mode, uint32_t from, uint32_t to, uint32_t step, uint32_t xtal, uint32_t bfo, unsigned threads)
+{
+  Config cfg;
+  cfg.mode = mode;
+  cfg.from = from;
+  cfg.to = to;
+  cfg.step = step;
+  cfg.xtal = xtal;
+  cfg.bfo = bfo;
+  cfg.count = (uint64_t)(to - from) / step + 1;
+  cfg.next_block = 0;
+
+  std::vector<Stats> st(threads);
+  std::vector<std::thread> th;
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+  for (unsigned i=0; i < threads; i++) {
+    memset(st[i].hist, 0, sizeof(st[i].hist));
+    st[i].points = st[i].refused = st[i].vco_low = st[i].vco_high = 0;
+    st[i].max_err = 0;
+    st[i].max_err_freq = 0;
+    st[i].busy_s = 0;
+    th.push_back(std::thread(worker, &cfg, &st[i]));
+  }
+  for (unsigned i=0; i < threads; i++) th[i].join();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+
+  Stats sum = st[0];
+  for (unsigned i=1; i < threads; i++) {
+    sum.points += st[i].points;
+    sum.refused += st[i].refused;
+    sum.vco_low += st[i].vco_low;
+    sum.vco_high += st[i].vco_high;
+    sum.busy_s += st[i].busy_s;
+    for (uint8_t h=0; h < HIST_SIZE; h++) sum.hist[h] += st[i].hist[h];
+    if (st[i].max_err > sum.max_err) {
+      sum.max_err = st[i].max_err;
+      sum.max_err_freq = st[i].max_err_freq;
+    }
+    sum.refused_ranges.insert(sum.refused_ranges.end(), st[i].refused_ranges.begin(), st[i].refused_ranges.end());
+    sum.vco_ranges.insert(sum.vco_ranges.end(), st[i].vco_ranges.begin(), st[i].vco_ranges.end());
+  }
+  merge_ranges(sum.refused_ranges, step);
+  merge_ranges(sum.vco_ranges, step);
+
+  printf("%s: %llu points %u-%u step %u, %u threads\n", mode_names[mode],
+    (unsigned long long)sum.points, from, to, step, threads);
+  printf("  max error %.6f Hz at %u\n", sum.max_err, sum.max_err_freq);
+  printf("  error:");
+  for (uint8_t h=0; h < HIST_SIZE; h++)
+    printf(" %s %llu", hist_names[h], (unsigned long long)sum.hist[h]);
+  printf("\n");
+  printf("  refused %llu, VCO below min %llu, above max %llu\n",
+    (unsigned long long)sum.refused, (unsigned long long)sum.vco_low, (unsigned long long)sum.vco_high);
+  print_ranges("refused", sum.refused_ranges);
+  print_ranges("VCO out of range", sum.vco_ranges);
+  printf("  %.0f plans/s total, %.0f plans/s per thread in set_freq, %.2f s\n",
+    sum.points / wall, sum.busy_s > 0 ? sum.points / sum.busy_s : 0.0, wall);
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t from = 8000, to = 200000000, step = 100;
+  uint32_t xtal = 25000000, bfo = 8867000;
+  unsigned threads = std::thread::hardware_concurrency();
+  std::vector<Mode> modes;
+  for (int i=1; i < argc; i++) {
+    if (argv[i][0] == '-' && i+1 < argc) {
+      uint32_t v = strtoul(argv[i+1], 0, 0);
+      switch (argv[i][1]) {
+        case 'f': from = v; i++; continue;
+        case 't': to = v; i++; continue;
+        case 's': step = v; i++; continue;
+        case 'j': threads = v; i++; continue;
+        case 'x': xtal = v; i++; continue;
+        case 'b': bfo = v; i++; continue;
+      }
+    } else {
+      bool found = false;
+      for (uint8_t m=0; m < 4; m++) {
+        if (!strcmp(argv[i], mode_names[m])) {
+          modes.push_back((Mode)m);
+          found = true;
+        }
+      }
+      if (found) continue;
+    }
+    fprintf(stderr, "usage: %s [-f from] [-t to] [-s step] [-j threads] [-x xtal] [-b bfo] [clk0|clk2|clk2i|quad...]\n", argv[0]);
+    return 1;
+  }
+  if (!step) step = 1;
+  if (!threads) threads = 1;
+  if (to < from) std::swap(from, to);
+  if (modes.empty())
+    for (uint8_t m=0; m < 4; m++) modes.push_back((Mode)m);
+
+  // static VCOFreq_Mid is written by setup(), once here, not from workers
+  Si5351 vfo;
+  vfo.setup();
+
+  for (size_t i=0; i < modes.size(); i++)
+    run(modes[i], from, to, step, xtal, bfo, threads);
+  return 0;
+}
@@ -0,0 +1,35 @@
+// Print and Serial for host builds, shared by extras/host/arduino_host.cpp
+// and extras/linux/arduino_linux.cpp
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include "Arduino.h"
+
+HostSerial Serial;
+
+size_t Print::print(unsigned long v, int base)
+{
+  char buf[33];
+  char* p = buf + sizeof(buf) - 1;
+  *p = 0;
+  do {
+    uint8_t d = v % base;
+    *--p = d < 10 ? '0' + d : 'A' + d - 10;
+    v /= base;
+  } while (v);
+  return write(p);
+}
+
+size_t Print::print(long v, int base)
+{
+  if (v < 0) return write((uint8_t)'-') + print((unsigned long)-v, base);
+  return print((unsigned long)v, base);
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// set_freq latency on different I2C buses, measured on the virtual clock
+// latency is time from set_freq call to the last bit on the wire (STOP).
+// hardware TWI is modeled by i2c_host (SCL rate + byte gap), SoftI2C runs
+// the real i2c_soft.cpp with its delayMicroseconds and per pin call cost.
+// CPU time of divider math is not included, see I2CStats.compute_us
+//
+// build (from this directory):
+//   g++ -O2 -I. -o tune_latency tune_latency.cpp i2c_host.cpp arduino_host.cpp
+//       print_host.cpp ../../si5351a.cpp ../../Si570.cpp ../../i2c_soft.cpp
+// usage:
+//   tune_latency [-n calls] [-g byte_gap_ns] [-p pin_ns] [-s seed]
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <Arduino.h>
+#include "i2c_host.h"
+#include "../../si5351a.h"
+#include "../../Si570.h"
+
+#define SI570_ADDR 0x55
+#define BFO_FREQ   9000000
+
+static uint32_t rnd_state;
+
+static uint32_t rnd()
+{
+  // xorshift32
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+// VFO knob: mostly small steps inside a band, sometimes a band change
+static std::vector<uint32_t> make_workload(uint32_t seed, uint32_t count)
+{
+  static const uint32_t bands[] = {1840000, 3600000, 7100000, 10120000, 14100000, 18100000, 21100000, 24900000, 28500000};
+  std::vector<uint32_t> w;
+  uint32_t f = 7100000;
+  rnd_state = seed ? seed : 1;
+  for (uint32_t i=0; i < count; i++) {
+    uint32_t r = rnd();
+    if (r % 100 < 5) {
+      f = bands[rnd() % (sizeof(bands)/sizeof(bands[0]))];
+    } else {
+      int32_t step = 10 + rnd() % 500;
+      f += (r & 0x10000) ? step : -step;
+    }
+    w.push_back(f);
+  }
+  return w;
+}
+
+struct Result {
+  std::vector<uint64_t> ns;
+  uint32_t resets;
+};
+
+static uint64_t percentile(const std::vector<uint64_t>& v, uint32_t p)
+{
+  if (v.empty()) return 0;
+  size_t i = (v.size() - 1) * p / 100;
+  return v[i];
+}
+
+static void report(const char* name, Result& r)
+{
+  std::sort(r.ns.begin(), r.ns.end());
+  uint64_t sum = 0;
+  for (size_t i=0; i < r.ns.size(); i++) sum += r.ns[i];
+  printf("%-22s %8.1f %8.1f %8.1f %8.1f %8.1f %7u\n", name,
+    r.ns.empty() ? 0.0 : sum / 1000.0 / r.ns.size(),
+    percentile(r.ns, 50) / 1000.0,
+    percentile(r.ns, 90) / 1000.0,
+    percentile(r.ns, 99) / 1000.0,
+    r.ns.empty() ? 0.0 : r.ns.back() / 1000.0,
+    r.resets);
+}
+
+static Result run_si5351(Si5351Base& vfo, const std::vector<uint32_t>& w)
+{
+  Result r;
+  r.resets = 0;
+  vfo.setup();
+  vfo.set_freq(w[0], BFO_FREQ);
+  for (size_t i=0; i < w.size(); i++) {
+    uint64_t t = host_time_ns();
+    uint8_t res = vfo.set_freq(w[i], BFO_FREQ);
+    r.ns.push_back(host_time_ns() - t);
+    if (res & ~SI5351_BUS_ERROR) r.resets++;
+  }
+  return r;
+}
+
+static Result run_si570(uint32_t scl_hz, uint32_t gap_ns, const std::vector<uint32_t>& w)
+{
+  // factory registers of 56.32 MHz part
+  uint8_t* regs = host_i2c_regs(SI570_ADDR);
+  static const uint8_t dco[6] = {0x01, 0xC2, 0xBC, 0x01, 0x1E, 0xB8};
+  memcpy(regs + 7, dco, sizeof(dco));
+
+  Result r;
+  r.resets = 0;
+  Si570 vfo;
+  vfo.setup(56320000);
+  host_i2c_set_clock(scl_hz, gap_ns);
+  vfo.set_freq(w[0]);
+  for (size_t i=0; i < w.size(); i++) {
+    // NewFreq bit self-clears on the chip, not in the stand-in
+    regs[135] = 0;
+    uint64_t t = host_time_ns();
+    vfo.set_freq(w[i]);
+    r.ns.push_back(host_time_ns() - t);
+    if (regs[135] & 0x40) r.resets++;
+  }
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t count = 10000;
+  uint32_t gap_ns = 0;
+  uint32_t pin_ns = 3500;
+  uint32_t seed = 1;
+  for (int i=1; i < argc; i++) {
+    if (i+1 < argc && argv[i][0] == '-') {
+      uint32_t v = strtoul(argv[i+1], 0, 0);
+      switch (argv[i][1]) {
+        case 'n': count = v; i++; continue;
+        case 'g': gap_ns = v; i++; continue;
+        case 'p': pin_ns = v; i++; continue;
+        case 's': seed = v; i++; continue;
+      }
+    }
+    fprintf(stderr, "usage: %s [-n calls] [-g byte_gap_ns] [-p pin_ns] [-s seed]\n", argv[0]);
+    return 1;
+  }
+  if (!count) count = 1;
+
+  std::vector<uint32_t> w = make_workload(seed, count);
+  static const uint32_t scl[] = {100000, 400000, 1000000};
+  static const uint16_t soft_delay[] = {4, 2, 1};
+  char name[32];
+
+  printf("%u calls, byte gap %u ns, pin call %u ns\n", count, gap_ns, pin_ns);
+  printf("%-22s %8s %8s %8s %8s %8s %7s\n", "bus", "mean us", "p50 us", "p90 us", "p99 us", "max us", "resets");
+
+  for (uint8_t i=0; i < 3; i++) {
+    Si5351 vfo;
+    host_i2c_set_clock(scl[i], gap_ns);
+    Result r = run_si5351(vfo, w);
+    snprintf(name, sizeof(name), "Si5351 TWI %u kHz", scl[i] / 1000);
+    report(name, r);
+  }
+  host_set_pin_ns(pin_ns);
+  for (uint8_t i=0; i < 3; i++) {
+    Si5351Soft vfo(SDA, SCL, false, soft_delay[i]);
+    Result r = run_si5351(vfo, w);
+    snprintf(name, sizeof(name), "Si5351 soft %u us", soft_delay[i]);
+    report(name, r);
+  }
+  host_set_pin_ns(0);
+  for (uint8_t i=0; i < 3; i++) {
+    Result r = run_si570(scl[i], gap_ns, w);
+    snprintf(name, sizeof(name), "Si570 TWI %u kHz", scl[i] / 1000);
+    report(name, r);
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+// Arduino time API on Linux with real clock
+// use instead of extras/host/arduino_host.cpp for driving real hardware
+// through i2c_linux. Print and Serial are in extras/host/print_host.cpp
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <time.h>
+#include "../host/Arduino.h"
+
+uint64_t host_time_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void host_advance_ns(uint64_t ns)
+{
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  while (nanosleep(&ts, &ts)) ;
+}
+
+void host_set_pin_ns(uint32_t)
+{
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(host_time_ns() / 1000);
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(host_time_ns() / 1000000);
+}
+
+void delay(unsigned long ms)
+{
+  host_advance_ns((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  host_advance_ns((uint64_t)us * 1000);
+}
+
+// no GPIO, SoftI2C is not usable on Linux
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+}
+
+int digitalRead(uint8_t)
+{
+  return HIGH;
+}
@@ -0,0 +1,147 @@
+// i2c_linux check against a mocked descriptor, runs on any Linux machine.
+// i2c_linux_ioctl is replaced by a register file that can NAK transfers:
+// one I2C_RDWR per burst, combined write + read, NAK reported by set_freq
+// with retry and full rewrite after error
+//
+// build (from this directory):
+//   g++ -O2 -I../host -o i2c_linux_test i2c_linux_test.cpp arduino_linux.cpp
+//       ../host/print_host.cpp ../../i2c_linux.cpp ../../si5351a.cpp
+//       ../../Si570.cpp ../../i2c_soft.cpp
+// usage:
+//   i2c_linux_test
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <Arduino.h>
+#include "../../i2c_linux.h"
+#include "../../si5351a.h"
+#include "../../Si570.h"
+
+#define SI5351_ADDR 0x60
+#define SI570_ADDR  0x55
+
+struct MockMsg {
+  uint16_t addr;
+  uint16_t flags;
+  std::vector<uint8_t> data;
+};
+
+static std::vector<std::vector<MockMsg> > calls;  // one entry per ioctl
+static uint32_t fail_left = 0;                    // next ioctls to NAK
+static uint8_t regs[128][256];
+static uint32_t failed = 0;
+
+static int mock_ioctl(int, unsigned long request, void* arg)
+{
+  if (request != I2C_RDWR) {
+    errno = ENOTTY;
+    return -1;
+  }
+  struct i2c_rdwr_ioctl_data* x = (struct i2c_rdwr_ioctl_data*)arg;
+  calls.push_back(std::vector<MockMsg>());
+  if (fail_left) {
+    fail_left--;
+    errno = ENXIO;
+    return -1;
+  }
+  uint8_t ptr = 0;
+  for (uint32_t i=0; i < x->nmsgs; i++) {
+    struct i2c_msg& m = x->msgs[i];
+    uint8_t* r = regs[m.addr & 0x7F];
+    if (m.flags & I2C_M_RD) {
+      for (uint16_t k=0; k < m.len; k++) m.buf[k] = r[ptr++];
+    } else {
+      // first byte is register, then payload
+      for (uint16_t k=0; k < m.len; k++) {
+        if (k) r[ptr++] = m.buf[k];
+        else ptr = m.buf[0];
+      }
+    }
+    MockMsg mm;
+    mm.addr = m.addr;
+    mm.flags = m.flags;
+    mm.data.assign(m.buf, m.buf + m.len);
+    calls.back().push_back(mm);
+  }
+  return x->nmsgs;
+}
+
+static void check(bool ok, const char* what)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) failed++;
+}
+
+int main()
+{
+  // any descriptor will do, transfers never reach it
+  if (!i2c_linux_open("/dev/null")) {
+    perror("/dev/null");
+    return 2;
+  }
+  i2c_linux_ioctl = mock_ioctl;
+
+  Si5351 si5351;
+  si5351.setup();
+  calls.clear();
+  uint8_t res = si5351.set_freq(7100000);
+  bool single = !calls.empty();
+  for (size_t i=0; i < calls.size(); i++)
+    single = single && calls[i].size() == 1 && calls[i][0].addr == SI5351_ADDR &&
+      !(calls[i][0].flags & I2C_M_RD) && calls[i][0].data.size() <= 9;
+  check(!(res & SI5351_BUS_ERROR) && single, "every Si5351 burst is one write ioctl");
+  check(calls.size() == 4, "set_freq from reset: PLL, multisynth, control, reset");
+  check(regs[SI5351_ADDR][16] == (0x4C | SI5351_CLK_DRIVE_8MA), "CLK0_CONTROL in register file");
+
+  calls.clear();
+  si5351.set_freq(7100100);
+  check(calls.size() == 1 && calls[0][0].data[0] > 26, "PLL only step writes changed span");
+
+  // factory registers of 56.32 MHz Si570
+  static const uint8_t dco[6] = {0x01, 0xC2, 0xBC, 0x01, 0x1E, 0xB8};
+  memcpy(regs[SI570_ADDR] + 7, dco, sizeof(dco));
+  Si570 si570;
+  calls.clear();
+  si570.setup(56320000);
+  bool combined = false;
+  for (size_t i=0; i < calls.size(); i++)
+    combined = combined || (calls[i].size() == 2 && calls[i][0].data.size() == 1 &&
+      calls[i][0].data[0] == 7 && (calls[i][1].flags & I2C_M_RD) && calls[i][1].data.size() == 6);
+  check(combined, "register read is one combined write + read ioctl");
+
+  // NAK is known only after the ioctl, in i2c_end
+  calls.clear();
+  si5351.set_retry(2, 0);
+  fail_left = 3;
+  res = si5351.set_freq(14100000);
+  check(res == SI5351_BUS_ERROR && !si5351.is_bus_ok(), "NAK returns SI5351_BUS_ERROR");
+  check(calls.size() == 3, "burst retried twice, next bursts skipped");
+
+  calls.clear();
+  res = si5351.set_freq(14100000);
+  check(!(res & SI5351_BUS_ERROR) && calls.size() == 4, "same freq after error rewrites all registers");
+
+  calls.clear();
+  fail_left = 1;
+  res = si5351.set_freq(3600000);
+  // PLL, multisynth, reset and one retry. CLK0_CONTROL is unchanged
+  check(!(res & SI5351_BUS_ERROR) && calls.size() == 4, "retry hides single NAK");
+
+  fail_left = 100;
+  check(!si570.set_freq(14000000), "Si570 NAK returns false");
+  fail_left = 0;
+  check(si570.set_freq(14000000), "Si570 recovers on next call");
+
+  i2c_linux_close();
+  printf("%s\n", failed ? "FAILED" : "passed");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+// si5351d client: post tune request and print applied state
+//
+// build (from this directory):
+//   g++ -O2 -o si5351c si5351c.cpp -lrt
+// usage:
+//   si5351c [-n shm_name] [-x] [-t timeout_ms] [-r repeat] [-i step] f0 [f1 [f2]]
+//   si5351c [-n shm_name] [-x] -s
+//   -x     - Si570 instead of Si5351
+//   -r, -i - post repeat requests with f0 += step back to back, wait for last
+//   -s     - print status only
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "tune_ring.h"
+
+static void print_status(const TuneStatus& st)
+{
+  printf("id %u result 0x%02X freq", st.id, st.result);
+  for (uint8_t i=0; i < st.count; i++) printf(" %u", st.f[i]);
+  if (st.resolution[0] || st.resolution[1] || st.resolution[2])
+    printf(" resolution %u/%u/%u mHz", st.resolution[0], st.resolution[1], st.resolution[2]);
+  printf("\nlatency %.1f us, bus %.1f us\n", (st.apply_ns - st.post_ns) / 1000.0, st.bus_ns / 1000.0);
+  printf("requests %u applied %u coalesced %u errors %u\n", st.requests, st.applied, st.requests - st.applied, st.errors);
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-n shm_name] [-x] [-t timeout_ms] [-r repeat] [-i step] f0 [f1 [f2]]\n"
+                  "       %s [-n shm_name] [-x] -s\n", name, name);
+}
+
+int main(int argc, char** argv)
+{
+  const char* name = TUNE_RING_NAME;
+  uint8_t device = TUNE_DEV_SI5351;
+  uint32_t timeout_ms = 1000, repeat = 1, step = 1;
+  bool status_only = false;
+  uint32_t f[3];
+  uint8_t count = 0;
+  for (int i=1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      switch (argv[i][1]) {
+        case 'x': device = TUNE_DEV_SI570; continue;
+        case 's': status_only = true; continue;
+      }
+      if (i+1 < argc) {
+        switch (argv[i][1]) {
+          case 'n': name = argv[++i]; continue;
+          case 't': timeout_ms = strtoul(argv[++i], 0, 0); continue;
+          case 'r': repeat = strtoul(argv[++i], 0, 0); continue;
+          case 'i': step = strtoul(argv[++i], 0, 0); continue;
+        }
+      }
+    } else if (count < 3) {
+      f[count++] = strtoul(argv[i], 0, 0);
+      continue;
+    }
+    usage(argv[0]);
+    return 1;
+  }
+  if (!status_only && (!count || (device == TUNE_DEV_SI570 && count > 1))) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  TuneShm* shm = tune_ring_open(name, false);
+  if (!shm) {
+    fprintf(stderr, "%s: %s\n", name, errno ? strerror(errno) : "bad version");
+    return 1;
+  }
+  if (!shm->daemon_pid.load()) {
+    fprintf(stderr, "daemon is not running\n");
+    return 1;
+  }
+
+  TuneStatus st;
+  if (status_only) {
+    tune_ring_status(shm, device, &st);
+    print_status(st);
+    return 0;
+  }
+
+  uint32_t id = 0;
+  uint64_t deadline = tune_ring_now_ns() + (uint64_t)timeout_ms * 1000000;
+  for (uint32_t n=0; n < repeat; n++) {
+    // ring full - daemon is busy on the bus, back off up to 10 ms
+    useconds_t backoff = 100;
+    while ((id = tune_ring_post(shm, device, count, f)) == 0) {
+      if (tune_ring_now_ns() > deadline) {
+        fprintf(stderr, "ring full\n");
+        return 1;
+      }
+      usleep(backoff);
+      if (backoff < 10000) backoff <<= 1;
+    }
+    f[0] += step;
+  }
+
+  if (!tune_ring_wait(shm, device, id, deadline, &st)) {
+    fprintf(stderr, "timeout\n");
+    return 1;
+  }
+  print_status(st);
+  tune_ring_close(shm);
+  return (st.result & TUNE_RESULT_ERROR) ? 2 : 0;
+}
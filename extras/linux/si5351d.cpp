@@ -0,0 +1,184 @@
+// tuning daemon: owns the I2C bus, takes requests from tune_ring.h shared
+// memory, applies only the newest request per device and publishes the
+// applied frequencies, set_freq result and timing
+//
+// build for hardware (from this directory):
+//   g++ -O2 -I../host -o si5351d si5351d.cpp arduino_linux.cpp ../host/print_host.cpp
+//       ../../i2c_linux.cpp ../../si5351a.cpp ../../Si570.cpp ../../i2c_soft.cpp -lrt
+// build against host simulator, bus time is slept in real time:
+//   g++ -O2 -DSI5351D_SIM -I../host -o si5351d_sim si5351d.cpp ../host/arduino_host.cpp
+//       ../host/print_host.cpp ../host/i2c_host.cpp ../../si5351a.cpp ../../Si570.cpp ../../i2c_soft.cpp -lrt
+// usage:
+//   si5351d [-d /dev/i2c-N] [-n shm_name] [-m mode] [-c scl_hz] [-x xtal] [-5 si570_cal_freq]
+//   -m - octal access mode of the ring, 0660 by default
+//   Si570 requests fail with TUNE_RESULT_ERROR when -5 is not given
+//   refuses to start while another daemon owns shm_name, ring left by a
+//   killed daemon is replaced
+//
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <Arduino.h>
+#include "tune_ring.h"
+#include "../../si5351a.h"
+#include "../../Si570.h"
+#ifdef SI5351D_SIM
+#include "../host/i2c_host.h"
+#define DEFAULT_DEV "sim"
+#else
+#include "../../i2c_linux.h"
+#define DEFAULT_DEV I2C_LINUX_DEFAULT_DEV
+#endif
+
+#define SI570_ADDR 0x55
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int)
+{
+  stop = 1;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  while (nanosleep(&ts, &ts) && !stop) ;
+}
+
+static void apply(TuneShm* shm, uint8_t device, const TuneCmd& cmd, uint32_t id, TuneStatus& st, Si5351& si5351, Si570* si570)
+{
+  uint64_t t = host_time_ns();
+  uint8_t res = 0;
+  if (device == TUNE_DEV_SI5351) {
+    switch (cmd.count) {
+      case 1: res = si5351.set_freq(cmd.f[0]); break;
+      case 2: res = si5351.set_freq(cmd.f[0], cmd.f[1]); break;
+      default: res = si5351.set_freq(cmd.f[0], cmd.f[1], cmd.f[2]); break;
+    }
+    for (uint8_t i=0; i < 3; i++) st.resolution[i] = si5351.resolution(i);
+  } else {
+    // no Si570 configured - complete request as failed, client must not wait
+    res = si570 && si570->set_freq(cmd.f[0]) ? 0 : TUNE_RESULT_ERROR;
+  }
+  uint64_t bus = host_time_ns() - t;
+#ifdef SI5351D_SIM
+  // virtual bus time to wall clock, so coalescing looks like on hardware
+  sleep_ns(bus);
+#endif
+  st.id = id;
+  st.count = cmd.count;
+  st.result = res;
+  memcpy(st.f, cmd.f, sizeof(st.f));
+  st.post_ns = cmd.post_ns;
+  st.apply_ns = tune_ring_now_ns();
+  st.bus_ns = (uint32_t)bus;
+  st.applied++;
+  if (res & TUNE_RESULT_ERROR) st.errors++;
+  tune_ring_publish(shm, device, &st);
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-d /dev/i2c-N] [-n shm_name] [-m mode] [-c scl_hz] [-x xtal] [-5 si570_cal_freq]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+  const char* dev = DEFAULT_DEV;
+  const char* name = TUNE_RING_NAME;
+  uint32_t scl = 400000, xtal = 25000000, si570_cal = 0;
+  mode_t mode = TUNE_RING_MODE;
+  for (int i=1; i < argc; i++) {
+    if (argv[i][0] == '-' && i+1 < argc) {
+      switch (argv[i][1]) {
+        case 'd': dev = argv[++i]; continue;
+        case 'n': name = argv[++i]; continue;
+        case 'm': mode = strtoul(argv[++i], 0, 8); continue;
+        case 'c': scl = strtoul(argv[++i], 0, 0); continue;
+        case 'x': xtal = strtoul(argv[++i], 0, 0); continue;
+        case '5': si570_cal = strtoul(argv[++i], 0, 0); continue;
+      }
+    }
+    usage(argv[0]);
+    return 1;
+  }
+
+#ifdef SI5351D_SIM
+  (void)dev;
+  // factory registers of 56.32 MHz Si570
+  static const uint8_t dco[6] = {0x01, 0xC2, 0xBC, 0x01, 0x1E, 0xB8};
+  memcpy(host_i2c_regs(SI570_ADDR) + 7, dco, sizeof(dco));
+#else
+  if (!i2c_linux_open(dev)) {
+    fprintf(stderr, "%s: %s\n", dev, strerror(errno));
+    return 1;
+  }
+#endif
+  i2c_init(scl);
+
+  TuneShm* shm = tune_ring_open(name, true, mode);
+  if (!shm) {
+    fprintf(stderr, "%s: %s\n", name, errno == EEXIST ? "another daemon is running" : strerror(errno));
+    return 1;
+  }
+
+  Si5351 si5351;
+  si5351.set_xtal_freq(xtal);
+  si5351.setup();
+  Si570* si570 = 0;
+  if (si570_cal) {
+    si570 = new Si570();
+    si570->setup(si570_cal);
+    // Si570::setup calls i2c_init() with default clock
+    i2c_init(scl);
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  TuneStatus st[TUNE_DEV_COUNT];
+  memset(st, 0, sizeof(st));
+  while (!stop) {
+    // drain ring, newest request per device wins
+    TuneCmd cmd, last[TUNE_DEV_COUNT];
+    uint32_t last_id[TUNE_DEV_COUNT] = {0, 0};
+    uint32_t id;
+    while ((id = tune_ring_pop(shm, &cmd)) != 0) {
+      uint8_t d = cmd.device;
+      if (d >= TUNE_DEV_COUNT) {
+        // client waiting on id must not run into its timeout
+        tune_ring_reject(shm, id);
+        continue;
+      }
+      st[d].requests++;
+      last[d].device = d;
+      last[d].count = cmd.count;
+      memcpy(last[d].f, cmd.f, sizeof(cmd.f));
+      last[d].post_ns = cmd.post_ns;
+      last_id[d] = id;
+    }
+    bool idle = true;
+    for (uint8_t d=0; d < TUNE_DEV_COUNT; d++) {
+      if (!last_id[d]) continue;
+      apply(shm, d, last[d], last_id[d], st[d], si5351, si570);
+      idle = false;
+    }
+    // futex sleep until next post, timeout only to notice signals
+    if (idle) tune_ring_idle(shm, 100000000);
+  }
+
+  shm->daemon_pid.store(0);
+  tune_ring_close(shm);
+  shm_unlink(name);
+  delete si570;
+  return 0;
+}
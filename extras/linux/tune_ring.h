@@ -0,0 +1,291 @@
+// shared memory command ring between si5351d and its clients
+// many producers (clients) post tune requests to a bounded lock-free ring,
+// one consumer (daemon) drains it. applied state of each device is
+// published back through a seqlock. idle daemon and waiting clients sleep
+// on futexes in the shared page, no polling
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef TUNE_RING_H
+#define TUNE_RING_H
+
+#include <inttypes.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+#include <new>
+
+#define TUNE_RING_NAME    "/si5351d"
+#define TUNE_RING_MAGIC   0x54554E45
+#define TUNE_RING_VERSION 2
+#define TUNE_RING_SIZE    64  // power of 2
+// access to the ring for clients in daemon's group
+#define TUNE_RING_MODE    0660
+
+#define TUNE_DEV_SI5351 0
+#define TUNE_DEV_SI570  1
+#define TUNE_DEV_COUNT  2
+
+// TuneStatus.result bit, same as SI5351_BUS_ERROR
+#define TUNE_RESULT_ERROR 0x01
+
+struct TuneCmd {
+  std::atomic<uint32_t> seq;
+  uint8_t device;
+  uint8_t count;   // freqs in f
+  uint32_t f[3];
+  uint64_t post_ns;
+};
+
+// applied state of one device
+struct TuneStatus {
+  uint32_t id;          // last applied request, requests with lower id are done too
+  uint8_t count;
+  uint8_t result;       // Si5351 set_freq result, Si570 - 0 or TUNE_RESULT_ERROR
+  uint32_t f[3];
+  uint32_t resolution[3]; // mHz, Si5351 only
+  uint64_t post_ns;     // CLOCK_MONOTONIC when request was posted
+  uint64_t apply_ns;    // CLOCK_MONOTONIC when write finished
+  uint32_t bus_ns;      // time inside set_freq
+  uint32_t requests;    // received
+  uint32_t applied;     // written
+  uint32_t errors;
+};
+
+struct TuneShm {
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> daemon_pid;  // 0 - daemon not running
+  std::atomic<uint32_t> tail;        // next slot for producers
+  uint32_t head;                     // daemon only
+  std::atomic<uint32_t> wake_seq;    // futex, bumped by every post
+  std::atomic<uint32_t> daemon_waiting; // daemon sleeps on wake_seq
+  std::atomic<uint32_t> rejected_id; // last request for unknown device, failed
+  TuneCmd ring[TUNE_RING_SIZE];
+  struct {
+    std::atomic<uint32_t> seq;       // odd while daemon updates status
+    TuneStatus status;
+  } dev[TUNE_DEV_COUNT];
+};
+
+inline uint64_t tune_ring_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word");
+
+// sleep while *word == val, up to timeout_ns. may return early
+inline void tune_ring_futex_wait(std::atomic<uint32_t>* word, uint32_t val, uint64_t timeout_ns)
+{
+  struct timespec ts;
+  ts.tv_sec = timeout_ns / 1000000000;
+  ts.tv_nsec = timeout_ns % 1000000000;
+  syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, val, &ts, 0, 0);
+}
+
+inline void tune_ring_futex_wake(std::atomic<uint32_t>* word)
+{
+  syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+// ring of a running daemon, not one left by a crash
+inline bool tune_ring_live(const char* name)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return false;
+  bool live = false;
+  struct stat sb;
+  // older or truncated ring is stale
+  if (fstat(fd, &sb) == 0 && (size_t)sb.st_size >= sizeof(TuneShm)) {
+    void* p = mmap(0, sizeof(TuneShm), PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      pid_t pid = ((TuneShm*)p)->daemon_pid.load();
+      live = pid && (kill(pid, 0) == 0 || errno == EPERM);
+      munmap(p, sizeof(TuneShm));
+    }
+  }
+  close(fd);
+  return live;
+}
+
+// create (daemon) or attach (client). return 0 on error, see errno.
+// create fails with EEXIST while another daemon owns the ring, stale ring
+// is replaced. mode is set on create regardless of umask
+inline TuneShm* tune_ring_open(const char* name, bool create, mode_t mode = TUNE_RING_MODE)
+{
+  int fd;
+  if (create) {
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+    if (fd < 0 && errno == EEXIST) {
+      if (tune_ring_live(name)) {
+        errno = EEXIST;
+        return 0;
+      }
+      shm_unlink(name);
+      fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode);
+    }
+  } else
+    fd = shm_open(name, O_RDWR, mode);
+  if (fd < 0) return 0;
+  if (create && (fchmod(fd, mode) < 0 || ftruncate(fd, sizeof(TuneShm)) < 0)) {
+    close(fd);
+    return 0;
+  }
+  void* p = mmap(0, sizeof(TuneShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return 0;
+  TuneShm* shm = (TuneShm*)p;
+  if (create) {
+    memset(p, 0, sizeof(TuneShm));
+    shm = new (p) TuneShm();
+    for (uint32_t i=0; i < TUNE_RING_SIZE; i++) shm->ring[i].seq.store(i, std::memory_order_relaxed);
+    shm->tail.store(0, std::memory_order_relaxed);
+    shm->head = 0;
+    shm->version = TUNE_RING_VERSION;
+    // owned from the start, second daemon can not take it over
+    shm->daemon_pid.store(getpid(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shm->magic = TUNE_RING_MAGIC;
+  } else if (shm->magic != TUNE_RING_MAGIC || shm->version != TUNE_RING_VERSION) {
+    munmap(p, sizeof(TuneShm));
+    return 0;
+  }
+  return shm;
+}
+
+inline void tune_ring_close(TuneShm* shm)
+{
+  munmap(shm, sizeof(TuneShm));
+}
+
+// client side. return request id or 0 if ring is full or device unknown
+inline uint32_t tune_ring_post(TuneShm* shm, uint8_t device, uint8_t count, const uint32_t* f)
+{
+  if (device >= TUNE_DEV_COUNT) return 0;
+  uint32_t pos = shm->tail.load(std::memory_order_relaxed);
+  TuneCmd* c;
+  for (;;) {
+    c = &shm->ring[pos & (TUNE_RING_SIZE-1)];
+    int32_t diff = (int32_t)(c->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (shm->tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return 0;
+    } else {
+      pos = shm->tail.load(std::memory_order_relaxed);
+    }
+  }
+  c->device = device;
+  c->count = count > 3 ? 3 : count;
+  for (uint8_t i=0; i < 3; i++) c->f[i] = i < count ? f[i] : 0;
+  c->post_ns = tune_ring_now_ns();
+  c->seq.store(pos+1, std::memory_order_release);
+  // daemon either sees new wake_seq before sleeping or is woken here
+  shm->wake_seq.fetch_add(1);
+  if (shm->daemon_waiting.load()) tune_ring_futex_wake(&shm->wake_seq);
+  // ring position is the id, so ids follow daemon order. 0 is never used
+  return pos+1 ? pos+1 : 1;
+}
+
+// daemon side. true if next request is ready
+inline bool tune_ring_pending(TuneShm* shm)
+{
+  uint32_t pos = shm->head;
+  return shm->ring[pos & (TUNE_RING_SIZE-1)].seq.load(std::memory_order_acquire) == pos+1;
+}
+
+// daemon side. sleep until a request is posted or timeout_ns
+inline void tune_ring_idle(TuneShm* shm, uint64_t timeout_ns)
+{
+  shm->daemon_waiting.store(1);
+  uint32_t w = shm->wake_seq.load();
+  if (!tune_ring_pending(shm)) tune_ring_futex_wait(&shm->wake_seq, w, timeout_ns);
+  shm->daemon_waiting.store(0);
+}
+
+// daemon side. copy next request, return its id or 0 if ring is empty
+inline uint32_t tune_ring_pop(TuneShm* shm, TuneCmd* out)
+{
+  uint32_t pos = shm->head;
+  TuneCmd* c = &shm->ring[pos & (TUNE_RING_SIZE-1)];
+  if (c->seq.load(std::memory_order_acquire) != pos+1) return 0;
+  out->device = c->device;
+  out->count = c->count;
+  memcpy(out->f, c->f, sizeof(out->f));
+  out->post_ns = c->post_ns;
+  c->seq.store(pos + TUNE_RING_SIZE, std::memory_order_release);
+  shm->head = pos+1;
+  return pos+1 ? pos+1 : 1;
+}
+
+// daemon side
+inline void tune_ring_publish(TuneShm* shm, uint8_t device, const TuneStatus* st)
+{
+  uint32_t s = shm->dev[device].seq.load(std::memory_order_relaxed);
+  shm->dev[device].seq.store(s+1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&shm->dev[device].status, st, sizeof(TuneStatus));
+  shm->dev[device].seq.store(s+2, std::memory_order_release);
+  tune_ring_futex_wake(&shm->dev[device].seq);
+}
+
+// daemon side. request with unknown device is done with TUNE_RESULT_ERROR
+inline void tune_ring_reject(TuneShm* shm, uint32_t id)
+{
+  shm->rejected_id.store(id);
+  for (uint8_t d=0; d < TUNE_DEV_COUNT; d++) tune_ring_futex_wake(&shm->dev[d].seq);
+}
+
+// client side, consistent copy of device status
+inline void tune_ring_status(TuneShm* shm, uint8_t device, TuneStatus* st)
+{
+  for (;;) {
+    uint32_t s = shm->dev[device].seq.load(std::memory_order_acquire);
+    if (s & 1) continue;
+    memcpy(st, &shm->dev[device].status, sizeof(TuneStatus));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shm->dev[device].seq.load(std::memory_order_relaxed) == s) return;
+  }
+}
+
+// request id was applied (or coalesced into a newer one)
+inline bool tune_ring_done(const TuneStatus* st, uint32_t id)
+{
+  return (int32_t)(st->id - id) >= 0 && st->id != 0;
+}
+
+// client side. sleep until request id is done or deadline (CLOCK_MONOTONIC).
+// st gets device status, result is TUNE_RESULT_ERROR if daemon rejected id.
+// return false on timeout
+inline bool tune_ring_wait(TuneShm* shm, uint8_t device, uint32_t id, uint64_t deadline_ns, TuneStatus* st)
+{
+  for (;;) {
+    uint32_t s = shm->dev[device].seq.load(std::memory_order_acquire);
+    tune_ring_status(shm, device, st);
+    if (tune_ring_done(st, id)) return true;
+    if (shm->rejected_id.load() == id) {
+      st->result = TUNE_RESULT_ERROR;
+      return true;
+    }
+    uint64_t now = tune_ring_now_ns();
+    if (now >= deadline_ns) return false;
+    // seq moved since load - returns at once
+    tune_ring_futex_wait(&shm->dev[device].seq, s, deadline_ns - now);
+  }
+}
+
+#endif
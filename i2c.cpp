@@ -18,17 +18,24 @@
 #define I2C_SLA_R_ACK 0x40
 #define I2C_DATA_ACK  0x28
 
+#ifdef I2C_STATS
+I2CStats i2c_stats;
+#endif
+
 uint8_t i2cStart()
 {
+  I2C_STAT(i2c_stats.transactions++);
 	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
 	while (!(TWCR & (1<<TWINT))) ;
 	return (TWSR & 0xF8);
 }
 
-void i2c_end()
+bool i2c_end()
 {
 	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
 	while ((TWCR & (1<<TWSTO))) ;
+  // every byte is acknowledged in i2c_write
+  return true;
 }
 
 bool i2c_write(uint8_t data)
@@ -37,13 +44,17 @@ bool i2c_write(uint8_t data)
 	TWCR = (1<<TWINT) | (1<<TWEN);
 	while (!(TWCR & (1<<TWINT))) ;
   uint8_t ret = TWSR & 0xF8;
-  return ret == I2C_DATA_ACK || ret == I2C_SLA_W_ACK || ret == I2C_SLA_R_ACK;
+  bool ack = ret == I2C_DATA_ACK || ret == I2C_SLA_W_ACK || ret == I2C_SLA_R_ACK;
+  I2C_STAT(i2c_stats.bytes++);
+  I2C_STAT(if (!ack) i2c_stats.naks++);
+  return ack;
 }
 
 uint8_t i2c_read()
 {
 	TWCR = (1<<TWINT) | (1<<TWEN);
 	while (!(TWCR & (1<<TWINT))) ;
+  I2C_STAT(i2c_stats.bytes++);
 	return (TWDR);
 }
 
@@ -52,11 +63,13 @@ uint8_t i2c_read_continue(bool last)
   if (last)	TWCR = (1<<TWINT) | (1<<TWEN);
   else      TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
 	while (!(TWCR & (1<<TWINT))) ;
+  I2C_STAT(i2c_stats.bytes++);
 	return (TWDR);
 }
 
 void i2c_read(uint8_t* data, uint8_t count)
 {
+  I2C_STAT(i2c_stats.bytes += count);
   while (count--) {
     if (count) TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
     else       TWCR = (1<<TWINT) | (1<<TWEN);
@@ -67,6 +80,7 @@ void i2c_read(uint8_t* data, uint8_t count)
 
 void i2c_read_long(uint8_t* data, uint16_t count)
 {
+  I2C_STAT(i2c_stats.bytes += count);
   while (count--) {
     if (count) TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
     else       TWCR = (1<<TWINT) | (1<<TWEN);
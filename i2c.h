@@ -10,6 +10,7 @@
 #define I2C_H
 
 #include <inttypes.h>
+#include "i2c_stats.h"
 
 void i2c_init(uint32_t i2c_freq = 100000);
 bool i2c_begin_write(uint8_t addr);
@@ -19,7 +20,14 @@ uint8_t i2c_read();
 void i2c_read(uint8_t* data, uint8_t count);
 void i2c_read_long(uint8_t* data, uint16_t count);
 uint8_t i2c_read_continue(bool last);
-void i2c_end();
+// STOP. false if transaction failed after last i2c_write returned:
+// buffering backend (i2c_linux) sends the whole burst here
+bool i2c_end();
 bool i2c_device_found(uint8_t addr);
 
+#ifdef I2C_STATS
+// transactions, bytes, naks
+extern I2CStats i2c_stats;
+#endif
+
 #endif
@@ -0,0 +1,160 @@
+// I2C over Linux i2c-dev
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "i2c_linux.h"
+
+#ifdef I2C_STATS
+I2CStats i2c_stats;
+#endif
+
+static int sys_ioctl(int fd, unsigned long request, void* arg)
+{
+  return ioctl(fd, request, arg);
+}
+
+int (*i2c_linux_ioctl)(int fd, unsigned long request, void* arg) = sys_ioctl;
+
+static int bus_fd = -1;
+static uint8_t wr_addr;
+static uint8_t wr_buf[I2C_LINUX_BUF_SIZE];
+static uint8_t wr_len;
+static bool wr_pending = false;  // between i2c_begin_write and i2c_end
+static bool rd_pending = false;  // after i2c_begin_read
+static bool xfer_ok = true;      // no failed ioctl since i2c_begin_write
+static uint8_t rd_addr;
+
+bool i2c_linux_open(const char* dev)
+{
+  i2c_linux_close();
+  bus_fd = open(dev, O_RDWR);
+  return bus_fd >= 0;
+}
+
+void i2c_linux_close()
+{
+  if (bus_fd >= 0) close(bus_fd);
+  bus_fd = -1;
+  wr_pending = rd_pending = false;
+}
+
+// send pending write and optional read as one combined transfer
+static bool transfer(uint8_t* rd_data, uint16_t rd_len)
+{
+  struct i2c_msg msgs[2];
+  struct i2c_rdwr_ioctl_data xfer;
+  uint8_t n = 0;
+  if (wr_pending && (wr_len || !rd_len)) {
+    msgs[n].addr = wr_addr;
+    msgs[n].flags = 0;
+    msgs[n].len = wr_len;
+    msgs[n].buf = wr_buf;
+    n++;
+  }
+  if (rd_len) {
+    msgs[n].addr = rd_addr;
+    msgs[n].flags = I2C_M_RD;
+    msgs[n].len = rd_len;
+    msgs[n].buf = rd_data;
+    n++;
+  }
+  wr_pending = false;
+  if (!n) return true;
+  xfer.msgs = msgs;
+  xfer.nmsgs = n;
+  bool ok = bus_fd >= 0 && i2c_linux_ioctl(bus_fd, I2C_RDWR, &xfer) >= 0;
+  if (!ok) xfer_ok = false;
+#ifdef I2C_STATS
+  i2c_stats.transactions++;
+  i2c_stats.bytes += wr_len + rd_len;
+  if (!ok) i2c_stats.naks++;
+#endif
+  wr_len = 0;
+  return ok;
+}
+
+void i2c_init(uint32_t)
+{
+  // bus speed is set by device tree
+  if (bus_fd < 0) i2c_linux_open(I2C_LINUX_DEFAULT_DEV);
+}
+
+bool i2c_begin_write(uint8_t addr)
+{
+  if (wr_pending) transfer(0, 0);
+  rd_pending = false;
+  wr_addr = addr;
+  wr_len = 0;
+  wr_pending = true;
+  xfer_ok = true;
+  // ACK is known after i2c_end
+  return bus_fd >= 0;
+}
+
+bool i2c_begin_read(uint8_t addr)
+{
+  rd_addr = addr;
+  rd_pending = true;
+  return bus_fd >= 0;
+}
+
+bool i2c_write(uint8_t data)
+{
+  if (!wr_pending || wr_len >= I2C_LINUX_BUF_SIZE) return false;
+  wr_buf[wr_len++] = data;
+  return true;
+}
+
+void i2c_read(uint8_t* data, uint8_t count)
+{
+  i2c_read_long(data, count);
+}
+
+void i2c_read_long(uint8_t* data, uint16_t count)
+{
+  if (!rd_pending || !transfer(data, count))
+    while (count--) *data++ = 0xFF;
+}
+
+uint8_t i2c_read()
+{
+  uint8_t data;
+  i2c_read_long(&data, 1);
+  return data;
+}
+
+// i2c-dev can not continue a read across ioctls,
+// so every byte is a separate read. use i2c_read(data,count) instead
+uint8_t i2c_read_continue(bool)
+{
+  return i2c_read();
+}
+
+// result of the burst or of combined register write + read
+bool i2c_end()
+{
+  if (wr_pending) transfer(0, 0);
+  rd_pending = false;
+  bool ok = xfer_ok;
+  xfer_ok = true;
+  return ok;
+}
+
+bool i2c_device_found(uint8_t addr)
+{
+  uint8_t data;
+  wr_pending = false;
+  rd_addr = addr;
+  return bus_fd >= 0 && transfer(&data, 1);
+}
+
+#endif
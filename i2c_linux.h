@@ -0,0 +1,40 @@
+// I2C over Linux i2c-dev
+// implements i2c.h API on /dev/i2c-N for single-board computers.
+// every write burst (i2c_begin_write .. i2c_end) is sent by one I2C_RDWR
+// ioctl, register address write + read by one combined ioctl
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+//
+// build with extras/host/Arduino.h, extras/linux/arduino_linux.cpp and
+// extras/host/print_host.cpp, e.g.
+//   g++ -O2 -Iextras/host app.cpp si5351a.cpp Si570.cpp i2c_soft.cpp
+//       i2c_linux.cpp extras/linux/arduino_linux.cpp extras/host/print_host.cpp
+
+#ifndef I2C_LINUX_H
+#define I2C_LINUX_H
+
+#ifdef __linux__
+
+#include <inttypes.h>
+#include "i2c.h"
+
+// used by i2c_init() if bus not opened yet
+#ifndef I2C_LINUX_DEFAULT_DEV
+#define I2C_LINUX_DEFAULT_DEV "/dev/i2c-1"
+#endif
+
+// max bytes in one write burst
+#define I2C_LINUX_BUF_SIZE 32
+
+// open bus device, return false on error (see errno)
+bool i2c_linux_open(const char* dev);
+void i2c_linux_close();
+
+// ioctl used for transfers. replace for testing against mocked descriptor
+extern int (*i2c_linux_ioctl)(int fd, unsigned long request, void* arg);
+
+#endif
+
+#endif
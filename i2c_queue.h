@@ -0,0 +1,45 @@
+// queued (non-blocking) I2C write interface
+// backend clocks queued transactions from an ISR, caller polls status
+// or gets done() callback. implemented by SoftI2CQueue (timer driven
+// bit engine) and used by Si5351Queued
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef I2C_QUEUE_H
+#define I2C_QUEUE_H
+
+#include <inttypes.h>
+
+// I2CXfer.status
+#define I2C_XFER_IDLE    0
+#define I2C_XFER_QUEUED  1
+#define I2C_XFER_ACTIVE  2
+#define I2C_XFER_DONE    3
+#define I2C_XFER_NAK     4
+
+struct I2CXfer;
+// called from ISR when transaction is finished
+typedef void (*I2CXferCallback)(I2CXfer* xfer);
+
+// write transaction: START, addr+W, data[0..len-1], STOP.
+// xfer and data are owned by the queue from submit until status is DONE or NAK
+struct I2CXfer {
+  uint8_t addr;  // 7 bit
+  uint8_t len;
+  const uint8_t* data;
+  I2CXferCallback done;
+  volatile uint8_t status;
+  I2CXfer* volatile next;
+};
+
+class I2CQueue {
+  public:
+    // add transaction to the end of queue, return false if it is still queued
+    virtual bool submit(I2CXfer* xfer) = 0;
+    // true while any transaction is queued or on the wire
+    virtual bool busy() = 0;
+};
+
+#endif
@@ -0,0 +1,73 @@
+// I2C transaction recorder
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include "i2c_recorder.h"
+
+#ifdef I2C_STATS
+
+static I2CRecord records[I2C_RECORDER_SIZE];
+static uint8_t rec_head = 0;
+static uint8_t rec_count = 0;
+static uint16_t rec_lost = 0;
+
+void i2c_rec_hook(uint8_t addr, const uint8_t* data, uint8_t len, uint8_t flags)
+{
+  I2CRecord* r = &records[rec_head];
+  r->time = micros();
+  r->addr = addr;
+  r->flags = flags;
+  if (len > I2C_RECORD_DATA) len = I2C_RECORD_DATA;
+  r->len = len;
+  for (uint8_t i=0; i < len; i++) r->data[i] = data[i];
+  if (++rec_head == I2C_RECORDER_SIZE) rec_head = 0;
+  if (rec_count < I2C_RECORDER_SIZE) rec_count++;
+  else rec_lost++;
+}
+
+void i2c_rec_clear()
+{
+  rec_head = rec_count = 0;
+  rec_lost = 0;
+}
+
+uint16_t i2c_rec_lost()
+{
+  return rec_lost;
+}
+
+static void print_hex(Print& out, uint8_t v)
+{
+  const char* digits = "0123456789ABCDEF";
+  out.write(digits[v >> 4]);
+  out.write(digits[v & 0xF]);
+}
+
+void i2c_rec_dump(Print& out)
+{
+  if (rec_lost) {
+    out.print("# lost ");
+    out.println(rec_lost);
+  }
+  uint8_t idx = (rec_head + I2C_RECORDER_SIZE - rec_count) % I2C_RECORDER_SIZE;
+  for (uint8_t n=0; n < rec_count; n++) {
+    I2CRecord* r = &records[idx];
+    out.print(r->time);
+    out.write(' ');
+    print_hex(out, r->addr);
+    out.write(' ');
+    out.write(r->flags & I2C_TRACE_CALL ? 'C' : (r->flags & I2C_TRACE_READ ? 'R' : 'W'));
+    if (r->flags & I2C_TRACE_NAK) out.write('!');
+    for (uint8_t i=0; i < r->len; i++) {
+      out.write(' ');
+      print_hex(out, r->data[i]);
+    }
+    out.println();
+    if (++idx == I2C_RECORDER_SIZE) idx = 0;
+  }
+  i2c_rec_clear();
+}
+
+#endif
@@ -0,0 +1,49 @@
+// I2C transaction recorder
+// ring buffer of the last I2C_RECORDER_SIZE transactions and API calls
+// requires I2C_STATS in si5351_config.h
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+//
+// usage:
+//   vfo.trace = i2c_rec_hook;
+//   ...
+//   i2c_rec_dump(Serial);
+//
+// dump format, one record per line, oldest first:
+//   <time_us> <addr> <type> <bytes>
+//   type: W - write, R - read, C - API call, ! appended on NAK
+//   bytes: register then payload for W/R, I2C_CALL_xxx op then args for C
+// extras/host/i2c_replay feeds dump back through the driver
+
+#ifndef I2C_RECORDER_H
+#define I2C_RECORDER_H
+
+#include <Arduino.h>
+#include <inttypes.h>
+#include "i2c_stats.h"
+
+#ifdef I2C_STATS
+
+#define I2C_RECORD_DATA 13
+
+struct I2CRecord {
+  uint32_t time;
+  uint8_t addr;
+  uint8_t flags;
+  uint8_t len;
+  uint8_t data[I2C_RECORD_DATA];
+};
+
+// I2CTraceHook compatible
+void i2c_rec_hook(uint8_t addr, const uint8_t* data, uint8_t len, uint8_t flags);
+void i2c_rec_clear();
+// number of records overwritten since last clear
+uint16_t i2c_rec_lost();
+// print records and clear buffer
+void i2c_rec_dump(Print& out);
+
+#endif
+
+#endif
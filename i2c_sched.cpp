@@ -0,0 +1,175 @@
+// interrupt driven TWI bus scheduler with priorities
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include <Arduino.h>
+#include "i2c_sched.h"
+
+#ifdef I2C_SCHEDULER
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define I2C_START     0x08
+#define I2C_START_RPT 0x10
+#define I2C_SLA_W_ACK 0x18
+#define I2C_DATA_ACK  0x28
+
+#define TWCR_GO ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+
+I2CScheduler i2c_sched;
+
+ISR(TWI_vect)
+{
+  i2c_sched.isr();
+}
+
+I2CScheduler::I2CScheduler()
+{
+  tune_head = tune_tail = cur_tune = 0;
+  bulk_head = bulk_tail = cur_bulk = 0;
+  cur_pos = cur_len = 0;
+  locked = false;
+}
+
+// transaction boundary, tuning first. ISR or interrupts disabled
+bool I2CScheduler::next_transaction()
+{
+  if (locked) return false;
+  if (tune_head) {
+    cur_tune = tune_head;
+    cur_tune->status = I2C_XFER_ACTIVE;
+    cur_len = cur_tune->len;
+  } else if (bulk_head) {
+    cur_bulk = bulk_head;
+    cur_bulk->status = I2C_XFER_ACTIVE;
+    uint16_t left = cur_bulk->len - cur_bulk->pos;
+    cur_len = cur_bulk->head_len + (left > I2C_SCHED_CHUNK ? I2C_SCHED_CHUNK : left);
+  } else
+    return false;
+  cur_pos = 0;
+  return true;
+}
+
+void I2CScheduler::finish(bool ack)
+{
+  if (cur_tune) {
+    I2CXfer* x = cur_tune;
+    cur_tune = 0;
+    tune_head = x->next;
+    if (!tune_head) tune_tail = 0;
+    x->status = ack ? I2C_XFER_DONE : I2C_XFER_NAK;
+    if (x->done) x->done(x);
+  } else {
+    I2CBulkXfer* x = cur_bulk;
+    cur_bulk = 0;
+    if (ack) x->pos += cur_len - x->head_len;
+    // unfinished transfer stays at head for next chunk
+    if (ack && x->pos < x->len) return;
+    bulk_head = x->next;
+    if (!bulk_head) bulk_tail = 0;
+    x->status = ack ? I2C_XFER_DONE : I2C_XFER_NAK;
+    if (x->done) x->done(x);
+  }
+}
+
+void I2CScheduler::isr()
+{
+  switch (TWSR & 0xF8) {
+    case I2C_START:
+    case I2C_START_RPT:
+      I2C_STAT(stats.transactions++);
+      TWDR = (cur_tune ? cur_tune->addr : cur_bulk->addr) << 1;
+      TWCR = TWCR_GO;
+      return;
+    case I2C_DATA_ACK:
+      I2C_STAT(stats.bytes++);
+      // fall through
+    case I2C_SLA_W_ACK:
+      if (cur_pos < cur_len) {
+        uint8_t i = cur_pos++;
+        if (cur_tune)
+          TWDR = cur_tune->data[i];
+        else if (i < cur_bulk->head_len)
+          TWDR = cur_bulk->head[i];
+        else
+          TWDR = cur_bulk->data[cur_bulk->pos + i - cur_bulk->head_len];
+        TWCR = TWCR_GO;
+        return;
+      }
+      finish(true);
+      break;
+    default:
+      // NAK, arbitration lost or bus error
+      I2C_STAT(stats.naks++);
+      finish(false);
+      break;
+  }
+  // STOP, and START right after it if something is waiting
+  if (next_transaction())
+    TWCR = TWCR_GO | (1<<TWSTO) | (1<<TWSTA);
+  else
+    TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+}
+
+// START if bus is idle, interrupts disabled
+void I2CScheduler::start()
+{
+  if (cur_tune || cur_bulk || !next_transaction()) return;
+  // STOP of last transaction may be still on the wire
+  while (TWCR & (1<<TWSTO)) ;
+  TWCR = TWCR_GO | (1<<TWSTA);
+}
+
+bool I2CScheduler::submit(I2CXfer* xfer)
+{
+  uint8_t st = xfer->status;
+  if (st == I2C_XFER_QUEUED || st == I2C_XFER_ACTIVE) return false;
+  xfer->next = 0;
+  xfer->status = I2C_XFER_QUEUED;
+  noInterrupts();
+  if (tune_tail) tune_tail->next = xfer;
+  else tune_head = xfer;
+  tune_tail = xfer;
+  start();
+  interrupts();
+  return true;
+}
+
+bool I2CScheduler::submit(I2CBulkXfer* xfer)
+{
+  uint8_t st = xfer->status;
+  if (st == I2C_XFER_QUEUED || st == I2C_XFER_ACTIVE) return false;
+  xfer->next = 0;
+  xfer->pos = 0;
+  xfer->status = I2C_XFER_QUEUED;
+  noInterrupts();
+  if (bulk_tail) bulk_tail->next = xfer;
+  else bulk_head = xfer;
+  bulk_tail = xfer;
+  start();
+  interrupts();
+  return true;
+}
+
+void I2CScheduler::lock()
+{
+  noInterrupts();
+  locked = true;
+  interrupts();
+  // at most one tuning write or one bulk chunk
+  while (cur_tune || cur_bulk) ;
+  while (TWCR & (1<<TWSTO)) ;
+}
+
+void I2CScheduler::release()
+{
+  noInterrupts();
+  locked = false;
+  start();
+  interrupts();
+}
+
+#endif
@@ -0,0 +1,81 @@
+// interrupt driven TWI bus scheduler with priorities
+// tuning writes (I2CXfer, I2CQueue interface) always go before bulk
+// transfers. bulk transfers (display frames) are split into chunks of
+// I2C_SCHED_CHUNK bytes, so tuning waits at most one chunk.
+// enabled by I2C_SCHEDULER in si5351_config.h, it owns TWI_vect
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef I2C_SCHED_H
+#define I2C_SCHED_H
+
+#include <inttypes.h>
+#include "si5351_config.h"
+#include "i2c_stats.h"
+#include "i2c_queue.h"
+
+#ifdef I2C_SCHEDULER
+
+struct I2CBulkXfer;
+// called from ISR when whole bulk transfer is finished
+typedef void (*I2CBulkCallback)(I2CBulkXfer* xfer);
+
+// long write sent as several transactions: START, addr+W, head, data chunk, STOP.
+// head is repeated in every chunk (e.g. 0x40 control byte of SSD1306)
+struct I2CBulkXfer {
+  uint8_t addr;  // 7 bit
+  uint8_t head_len;  // 0..2
+  uint8_t head[2];
+  const uint8_t* data;
+  uint16_t len;
+  I2CBulkCallback done;
+  volatile uint8_t status;  // I2C_XFER_xxx
+  uint16_t pos;  // sent data bytes
+  I2CBulkXfer* volatile next;
+};
+
+class I2CScheduler: public I2CQueue {
+  private:
+    I2CXfer* volatile tune_head;
+    I2CXfer* volatile tune_tail;
+    I2CBulkXfer* volatile bulk_head;
+    I2CBulkXfer* volatile bulk_tail;
+    // transaction on the wire
+    I2CXfer* volatile cur_tune;
+    I2CBulkXfer* volatile cur_bulk;
+    uint8_t cur_pos, cur_len;
+    volatile bool locked;
+    bool next_transaction();
+    void finish(bool ack);
+    void start();
+  public:
+    I2CScheduler();
+
+#ifdef I2C_STATS
+    // transactions, bytes, naks
+    I2CStats stats = {};
+#endif
+
+    // i2c_init() first
+    // tuning priority
+    bool submit(I2CXfer* xfer);
+    // bulk priority, data must live until status is DONE or NAK
+    bool submit(I2CBulkXfer* xfer);
+    bool busy() { return tune_head || bulk_head || cur_tune || cur_bulk; }
+
+    // wait for current transaction and hold the bus for blocking
+    // i2c_xxx calls (reads, Si570). queued transfers wait for release
+    void lock();
+    void release();
+
+    // TWI_vect handler
+    void isr();
+};
+
+extern I2CScheduler i2c_sched;
+
+#endif
+
+#endif
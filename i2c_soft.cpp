@@ -46,6 +46,7 @@ bool SoftI2C::i2c_init(uint16_t delay_us)
 // Return: true if the slave replies with an "acknowledge", false otherwise
 bool SoftI2C::i2c_start(uint8_t addr) 
 {
+  I2C_STAT(stats.transactions++);
   setLow(_sda);
   delayMicroseconds(_delay_us);
   setLow(_scl);
@@ -53,7 +54,8 @@ bool SoftI2C::i2c_start(uint8_t addr)
 }
 
 // Issue a stop condition, freeing the bus.
-void SoftI2C::i2c_end(void) 
+// Return: true, every byte is acknowledged in i2c_write
+bool SoftI2C::i2c_end(void) 
 {
   setLow(_sda);
   delayMicroseconds(_delay_us);
@@ -61,6 +63,7 @@ void SoftI2C::i2c_end(void)
   delayMicroseconds(_delay_us);
   setHigh(_sda);
   delayMicroseconds(_delay_us);
+  return true;
 }
 
 bool SoftI2C::i2c_begin_read(uint8_t addr)
@@ -90,6 +93,8 @@ bool SoftI2C::i2c_write(uint8_t value)
   setLow(_scl);
   delayMicroseconds(_delay_us/2);  
   setLow(_sda);
+  I2C_STAT(stats.bytes++);
+  I2C_STAT(if (ack) stats.naks++);
   return ack == 0;
 }
 
@@ -112,6 +117,7 @@ uint8_t SoftI2C::i2c_read_continue(bool last)
   setLow(_scl);
   delayMicroseconds(_delay_us/2);  
   setLow(_sda);
+  I2C_STAT(stats.bytes++);
   return b;
 }
 
@@ -140,3 +146,160 @@ void SoftI2C::setHigh(uint8_t pin) {
     interrupts();
 }
 
+// queued engine states
+#define SQ_IDLE   0
+#define SQ_BIT_A  1  // SCL low, set SDA
+#define SQ_BIT_B  2  // SCL high
+#define SQ_ACK_A  3  // SCL low, release SDA
+#define SQ_ACK_B  4  // SCL high, sample ACK
+#define SQ_STOP_A 5  // SCL low, SDA low
+#define SQ_STOP_B 6  // SCL high
+#define SQ_STOP_C 7  // SDA high
+
+static void pin_init(SoftI2CPin& p, uint8_t pin)
+{
+#ifdef __AVR__
+  uint8_t port = digitalPinToPort(pin);
+  p.ddr = portModeRegister(port);
+  p.port = portOutputRegister(port);
+  p.in = portInputRegister(port);
+  p.bit = digitalPinToBitMask(pin);
+#else
+  p.pin = pin;
+#endif
+}
+
+SoftI2CQueue::SoftI2CQueue(uint8_t sda_pin, uint8_t scl_pin, bool pullup): SoftI2C(sda_pin, scl_pin, pullup)
+{
+  pin_init(sda, sda_pin);
+  pin_init(scl, scl_pin);
+  head = tail = 0;
+  state = SQ_IDLE;
+}
+
+bool SoftI2CQueue::submit(I2CXfer* xfer)
+{
+  uint8_t st = xfer->status;
+  if (st == I2C_XFER_QUEUED || st == I2C_XFER_ACTIVE) return false;
+  xfer->next = 0;
+  xfer->status = I2C_XFER_QUEUED;
+  // pointers are not atomic on AVR, list link must not be torn by tick()
+  noInterrupts();
+  if (tail) tail->next = xfer;
+  else head = xfer;
+  tail = xfer;
+  interrupts();
+  return true;
+}
+
+void SoftI2CQueue::complete()
+{
+  I2CXfer* x = head;
+  head = x->next;
+  if (!head) tail = 0;
+  I2C_STAT(if (nak) stats.naks++);
+  x->status = nak ? I2C_XFER_NAK : I2C_XFER_DONE;
+  if (x->done) x->done(x);
+}
+
+void SoftI2CQueue::tick()
+{
+  switch (state) {
+    case SQ_IDLE:
+      if (!head) return;
+      head->status = I2C_XFER_ACTIVE;
+      I2C_STAT(stats.transactions++);
+      shift = head->addr << 1;
+      mask = 0x80;
+      pos = 0;
+      nak = false;
+      // START: SDA falls while SCL is high
+      lineLow(sda);
+      state = SQ_BIT_A;
+      break;
+    case SQ_BIT_A:
+      lineLow(scl);
+      if (shift & mask) lineHigh(sda);
+      else lineLow(sda);
+      state = SQ_BIT_B;
+      break;
+    case SQ_BIT_B:
+      lineHigh(scl);
+      mask >>= 1;
+      state = mask ? SQ_BIT_A : SQ_ACK_A;
+      break;
+    case SQ_ACK_A:
+      lineLow(scl);
+      lineHigh(sda);
+      state = SQ_ACK_B;
+      break;
+    case SQ_ACK_B:
+      lineHigh(scl);
+      I2C_STAT(stats.bytes++);
+      if (lineRead(sda)) {
+        nak = true;
+        state = SQ_STOP_A;
+      } else if (pos == head->len) {
+        state = SQ_STOP_A;
+      } else {
+        shift = head->data[pos++];
+        mask = 0x80;
+        state = SQ_BIT_A;
+      }
+      break;
+    case SQ_STOP_A:
+      lineLow(scl);
+      lineLow(sda);
+      state = SQ_STOP_B;
+      break;
+    case SQ_STOP_B:
+      lineHigh(scl);
+      state = SQ_STOP_C;
+      break;
+    case SQ_STOP_C:
+      lineHigh(sda);
+      complete();
+      state = SQ_IDLE;
+      break;
+  }
+}
+
+#if defined(SOFT_I2C_TIMER2) && defined(__AVR__)
+#include <avr/interrupt.h>
+
+static SoftI2CQueue* timer2_queue = 0;
+
+ISR(TIMER2_COMPA_vect)
+{
+  timer2_queue->tick();
+}
+
+void soft_i2c_timer2_begin(SoftI2CQueue* queue, uint32_t tick_hz)
+{
+  static const uint16_t prescale[] = {1, 8, 32, 64, 128, 256, 1024};
+  uint8_t ps = 0;
+  if (tick_hz > SOFT_I2C_TIMER2_MAX_HZ) tick_hz = SOFT_I2C_TIMER2_MAX_HZ;
+  if (!tick_hz) tick_hz = 1;
+  uint32_t top = F_CPU / tick_hz;
+  while (top > 256 && ps < 6) {
+    ps++;
+    top = F_CPU / prescale[ps] / tick_hz;
+  }
+  if (top > 256) top = 256;
+  if (top < 1) top = 1;
+  timer2_queue = queue;
+  noInterrupts();
+  TCCR2A = 1 << WGM21;  // CTC
+  TCCR2B = ps + 1;      // CS22..CS20 = prescaler index + 1
+  OCR2A = top - 1;
+  TCNT2 = 0;
+  TIMSK2 |= 1 << OCIE2A;
+  interrupts();
+}
+
+void soft_i2c_timer2_end()
+{
+  TIMSK2 &= ~(1 << OCIE2A);
+  TCCR2B = 0;
+}
+#endif
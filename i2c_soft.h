@@ -22,9 +22,11 @@
 
 #include <Arduino.h>
 #include <inttypes.h>
+#include "i2c_stats.h"
+#include "i2c_queue.h"
 
 class SoftI2C {
-  private:
+  protected:
     void setHigh(uint8_t pin);
     void setLow(uint8_t pin);
     uint8_t _sda;
@@ -37,6 +39,11 @@ class SoftI2C {
   public:
     SoftI2C(uint8_t sda, uint8_t scl, bool internal_pullup);
 
+#ifdef I2C_STATS
+    // transactions, bytes, naks
+    I2CStats stats = {};
+#endif
+
     bool i2c_init(uint16_t delay_us = 4);
 
     bool i2c_begin_write(uint8_t addr) { return i2c_start(addr<<1); }
@@ -46,7 +53,61 @@ class SoftI2C {
     void i2c_read(uint8_t* data, uint8_t count);
     void i2c_read_long(uint8_t* data, uint16_t count);
     uint8_t i2c_read_continue(bool last);
-    void i2c_end();
+    bool i2c_end();
+};
+
+// pin of SoftI2CQueue, port registers are looked up once in constructor
+struct SoftI2CPin {
+#ifdef __AVR__
+  volatile uint8_t* ddr;
+  volatile uint8_t* port;
+  volatile uint8_t* in;
+  uint8_t bit;
+#else
+  uint8_t pin;
+#endif
 };
 
+// non-blocking SoftI2C: tick() clocks one bus phase of queued transactions.
+// call it from a timer ISR at 2x SCL rate. on AVR tick() drives the lines
+// by port registers, about 150 cycles per call with ISR overhead, so the
+// main loop keeps most of CPU up to SOFT_I2C_TIMER2_MAX_HZ.
+// i2c_init() first. do not mix with blocking SoftI2C calls on the same pins
+class SoftI2CQueue: public SoftI2C, public I2CQueue {
+  private:
+    SoftI2CPin sda, scl;
+#ifdef __AVR__
+    // open drain: PORT bit low before DDR output, pullup after release
+    void lineHigh(SoftI2CPin& p) { *p.ddr &= ~p.bit; if (pin_mode == INPUT_PULLUP) *p.port |= p.bit; }
+    void lineLow(SoftI2CPin& p) { *p.port &= ~p.bit; *p.ddr |= p.bit; }
+    bool lineRead(SoftI2CPin& p) { return *p.in & p.bit; }
+#else
+    void lineHigh(SoftI2CPin& p) { pinMode(p.pin, pin_mode); }
+    void lineLow(SoftI2CPin& p) { digitalWrite(p.pin, LOW); pinMode(p.pin, OUTPUT); }
+    bool lineRead(SoftI2CPin& p) { return digitalRead(p.pin); }
+#endif
+    I2CXfer* volatile head;
+    I2CXfer* volatile tail;
+    volatile uint8_t state;
+    uint8_t shift, mask, pos;
+    bool nak;
+    void complete();
+  public:
+    SoftI2CQueue(uint8_t sda, uint8_t scl, bool internal_pullup);
+
+    bool submit(I2CXfer* xfer);
+    bool busy() { return head != 0; }
+
+    // one bus phase, ISR context
+    void tick();
+};
+
+#ifdef SOFT_I2C_TIMER2
+// drive queue by AVR Timer2 compare interrupt, tick_hz = 2x SCL, clamped
+// to SOFT_I2C_TIMER2_MAX_HZ. call queue->i2c_init() first.
+// Timer2 is not available for tone() then
+void soft_i2c_timer2_begin(SoftI2CQueue* queue, uint32_t tick_hz);
+void soft_i2c_timer2_end();
+#endif
+
 #endif
@@ -0,0 +1,76 @@
+// Full-featured library for Si5351
+// I2C instrumentation (enabled by I2C_STATS in si5351_config.h)
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef I2C_STATS_H
+#define I2C_STATS_H
+
+#include <inttypes.h>
+#include "si5351_config.h"
+
+// trace flags
+#define I2C_TRACE_WRITE  0x00
+#define I2C_TRACE_READ   0x01
+#define I2C_TRACE_NAK    0x02
+#define I2C_TRACE_CALL   0x04  // API call record, not a bus transaction
+
+// API call records: data[0] = op, then uint32 arguments, little endian
+#define I2C_CALL_SETUP      1  // Si5351: power0,power1,power2. Si570: calibration freq
+#define I2C_CALL_XTAL       2  // xtal freq
+#define I2C_CALL_POWER      3  // clk_num, power
+#define I2C_CALL_FREQ       4  // f0 [,f1 [,f2]]
+#define I2C_CALL_QUAD       5  // f01, f2, inverse_phase
+#define I2C_CALL_CALIBRATE  6
+#define I2C_CALL_OUTPUTS    7  // mask
+#define I2C_CALL_PPB        8  // ppb, signed
+#define I2C_CALL_PLAN       9  // clk_num | power << 8, freq, xtal of the plan
+#define I2C_CALL_SWEEP      10 // clk_num | count << 8, start, step (signed)
+#define I2C_CALL_SWEEP_STOP 11 // points passed, after sweep ended before count
+#define I2C_CALL_SWEEP_LIST 12 // clk_num | count << 8, first, last. list is not recorded
+#define I2C_CALL_MOD_BEGIN  13 // clk_num, deviation
+#define I2C_CALL_MOD_SAMPLE 14 // sample, signed
+#define I2C_CALL_MOD_END    15
+#define I2C_CALL_RESET_DEFER 16 // quiet_ms
+#define I2C_CALL_FLUSH_RESET 17 // poll() or flush_reset() with pending reset
+#define I2C_CALL_QUANTUM    18 // hz
+#define I2C_CALL_PINGPONG   19 // clk_num, freq
+#define I2C_CALL_PINGPONG_PREPARE 20 // freq
+#define I2C_CALL_RECENTER   21 // Si570: freq
+#define I2C_CALL_SPAN       22 // Si570: lo, hi
+
+struct I2CStats {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t naks;
+  uint32_t pll_resets;  // Si5351 PLL reset / Si570 NewFreq
+  uint32_t fast_tunes;  // PLL/RFREQ only
+  uint32_t slow_tunes;  // dividers changed
+  uint32_t compute_us;  // time in set_freq except bus I/O
+  uint32_t bus_us;      // time in bus I/O
+};
+
+// called after each transaction. data[0] is register, data[1..len-1] is payload
+// or before each API call with I2C_TRACE_CALL flag
+typedef void (*I2CTraceHook)(uint8_t addr, const uint8_t* data, uint8_t len, uint8_t flags);
+
+#ifdef I2C_STATS
+  #define I2C_STAT(x) x
+
+// pass API call record to trace hook
+inline void i2c_trace_call(I2CTraceHook hook, uint8_t addr, uint8_t op, uint8_t argc, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0)
+{
+  if (!hook) return;
+  uint32_t args[3] = {a0,a1,a2};
+  uint8_t buf[13];
+  buf[0] = op;
+  for (uint8_t i=0; i < argc*4; i++) buf[i+1] = ((uint8_t*)args)[i];
+  hook(addr, buf, 1+argc*4, I2C_TRACE_CALL);
+}
+#else
+  #define I2C_STAT(x)
+#endif
+
+#endif
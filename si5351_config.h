@@ -0,0 +1,71 @@
+// Full-featured library for Si5351
+// compile-time configuration
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#ifndef SI5351_CONFIG_H
+#define SI5351_CONFIG_H
+
+// uncomment for enable transaction/timing counters and trace hook
+// in Si5351Base, Si570, i2c and SoftI2C. disabled = zero cost
+//#define I2C_STATS
+
+// number of records in i2c_recorder ring buffer (20 bytes each), max 255.
+// 16 takes 320 bytes RAM, ok next to an ATmega328 sketch but holds only a
+// few tunes: older records are overwritten ("# lost" in the dump) and
+// i2c_replay refuses such a capture. for field captures from setup() on
+// use 64..100 (1.3..2 kB) on bigger chips, or dump often into one log
+#ifndef I2C_RECORDER_SIZE
+#define I2C_RECORDER_SIZE 16
+#endif
+
+// lean profile for ATmega328 class: constant tables in flash,
+// fixed VCO limits, hardware I2C only without vtable
+//#define SI5351_LEAN
+
+// drop unused features
+//#define SI5351_NO_QUADRATURE  // set_freq_quadrature
+//#define SI5351_NO_CLK2_FRAC   // set_freq(f0,f1,f2)
+//#define SI5351_NO_SOFT_I2C    // Si5351Soft
+//#define SI5351_NO_MODULATION  // mod_begin/mod_sample
+//#define SI5351_NO_PINGPONG    // set_freq_pingpong
+
+// Si5351Queued: transactions in flight, 9 bytes each
+#ifndef SI5351_QUEUE_DEPTH
+#define SI5351_QUEUE_DEPTH 4
+#endif
+
+// SoftI2CQueue driven by Timer2 compare ISR (AVR only)
+//#define SOFT_I2C_TIMER2
+
+// Timer2 tick limit, 2x SCL. ~150 cycles per tick: 40 kHz is ~40% of
+// 16 MHz CPU. raise after checking ISR load on your board
+#ifndef SOFT_I2C_TIMER2_MAX_HZ
+#define SOFT_I2C_TIMER2_MAX_HZ 40000
+#endif
+
+// i2c_sched: TWI interrupt scheduler, tuning before display traffic.
+// takes TWI_vect, so no Wire library then
+//#define I2C_SCHEDULER
+
+// i2c_sched bulk chunk, data bytes per transaction
+#ifndef I2C_SCHED_CHUNK
+#define I2C_SCHED_CHUNK 16
+#endif
+
+// computed PLL images of last used frequencies (19 bytes each), 0 - off
+#ifndef SI5351_PLAN_CACHE
+#ifdef SI5351_LEAN
+#define SI5351_PLAN_CACHE 0
+#else
+#define SI5351_PLAN_CACHE 4
+#endif
+#endif
+
+#ifdef SI5351_LEAN
+#define SI5351_NO_SOFT_I2C
+#endif
+
+#endif
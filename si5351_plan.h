@@ -0,0 +1,98 @@
+// Full-featured library for Si5351
+// compile-time frequency plans
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+//
+// register image for fixed output is computed by compiler and stored in flash:
+//
+//   SI5351_PLAN(bfo_plan, 2, 25000000, 8998500);
+//   ...
+//   vfo.apply_plan(&bfo_plan);
+//
+// plan is the same as set_freq gives for one output from reset state:
+// CLK0 - PLL_A, CLK1,CLK2 - PLL_B, multisynth integer
+
+#ifndef SI5351_PLAN_H
+#define SI5351_PLAN_H
+
+#include <inttypes.h>
+#include "si5351a.h"
+
+namespace si5351_plan {
+
+// default Si5351Base::VCOFreq_Min/Max
+constexpr uint32_t vco_min = 600000000;
+constexpr uint32_t vco_max = 900000000;
+constexpr uint32_t vco_mid = (vco_min + vco_max) >> 1;
+
+// divider selection from Si5351Base::update_freq
+constexpr uint32_t div_mid(uint32_t f) { return vco_mid / f < 6 ? 4 : vco_mid / f; }
+constexpr uint8_t rdiv_of(uint32_t d, uint8_t r) { return d > 300 ? rdiv_of(d >> 1, r+1) : r; }
+constexpr uint32_t div_of(uint32_t d) { return d > 300 ? div_of(d >> 1) : d; }
+constexpr uint8_t rdiv(uint32_t f) { return rdiv_of(div_mid(f), 0); }
+constexpr uint32_t divider(uint32_t f) { return rdiv(f) ? div_of(div_mid(f)) : div_of(div_mid(f)) & 0xFFFFFFFE; }
+constexpr uint32_t pll_freq(uint32_t f) { return divider(f) * f << rdiv(f); }
+// R divider is 3 bits
+constexpr bool valid(uint32_t f) { return f && vco_mid / f >= 4 && rdiv(f) <= 7; }
+
+// PLL parameters from Si5351Base::si5351_calc_pll
+constexpr uint32_t pll_b(uint32_t xtal, uint32_t pll) { return (pll % xtal) >> 5; }
+constexpr uint32_t pll_t(uint32_t xtal, uint32_t pll) { return 128 * pll_b(xtal, pll) / (xtal >> 5); }
+constexpr uint32_t pll_p1(uint32_t xtal, uint32_t pll) { return 128 * (pll / xtal) + pll_t(xtal, pll) - 512; }
+constexpr uint32_t pll_p2(uint32_t xtal, uint32_t pll) { return 128 * pll_b(xtal, pll) - (xtal >> 5) * pll_t(xtal, pll); }
+constexpr uint32_t pll_p3(uint32_t xtal) { return xtal >> 5; }
+
+// byte i of packed parameters, see si5351_pack_regs
+constexpr uint8_t reg(uint8_t i, uint32_t P1, uint32_t P2, uint32_t P3, uint8_t rDiv, bool divby4)
+{
+  return
+    i == 0 ? (uint8_t)(P3 >> 8) :
+    i == 1 ? (uint8_t)P3 :
+    i == 2 ? (uint8_t)(((P1 >> 16) & 0x3) | rDiv | (divby4 ? 0x0C : 0x00)) :
+    i == 3 ? (uint8_t)(P1 >> 8) :
+    i == 4 ? (uint8_t)P1 :
+    i == 5 ? (uint8_t)(((P3 & 0x000F0000) >> 12) | ((P2 & 0x000F0000) >> 16)) :
+    i == 6 ? (uint8_t)(P2 >> 8) :
+    (uint8_t)P2;
+}
+
+constexpr uint8_t pll_reg(uint8_t i, uint32_t xtal, uint32_t f)
+{
+  return reg(i, pll_p1(xtal, pll_freq(f)), pll_p2(xtal, pll_freq(f)), pll_p3(xtal), 0, false);
+}
+
+constexpr uint8_t ms_reg(uint8_t i, uint32_t f)
+{
+  return reg(i, 128 * divider(f) - 512, 0, 1, rdiv(f) << 4, divider(f) == 4);
+}
+
+constexpr Si5351Plan make(uint8_t clk_num, uint32_t xtal, uint32_t f, uint8_t power)
+{
+  return {
+    f, pll_freq(f), xtal, (uint16_t)divider(f), clk_num, rdiv(f),
+    // SI_SYNTH_PLL_A/B
+    { (uint8_t)(clk_num ? 34 : 26),
+      pll_reg(0, xtal, f), pll_reg(1, xtal, f), pll_reg(2, xtal, f), pll_reg(3, xtal, f),
+      pll_reg(4, xtal, f), pll_reg(5, xtal, f), pll_reg(6, xtal, f), pll_reg(7, xtal, f) },
+    // SI_SYNTH_MS_x
+    { (uint8_t)(42 + clk_num*8),
+      ms_reg(0, f), ms_reg(1, f), ms_reg(2, f), ms_reg(3, f),
+      ms_reg(4, f), ms_reg(5, f), ms_reg(6, f), ms_reg(7, f) },
+    // CLKx_CONTROL: integer mode, multisynth source, PLL_B for CLK1,CLK2
+    (uint8_t)(0x4C | power | (clk_num ? 0x20 : 0x00))
+  };
+}
+
+}
+
+#define SI5351_PLAN(name, clk_num, xtal, freq) \
+  static_assert(si5351_plan::valid(freq), "Si5351 plan: frequency out of range"); \
+  constexpr Si5351Plan name PROGMEM = si5351_plan::make(clk_num, xtal, freq, SI5351_CLK_DRIVE_8MA)
+
+#define SI5351_PLAN_POWER(name, clk_num, xtal, freq, power) \
+  static_assert(si5351_plan::valid(freq), "Si5351 plan: frequency out of range"); \
+  constexpr Si5351Plan name PROGMEM = si5351_plan::make(clk_num, xtal, freq, power)
+
+#endif
@@ -5,11 +5,13 @@
 // http://dspview.com
 // https://github.com/andrey-belokon
 
+#include <Arduino.h>
 #include <inttypes.h>
 #include "si5351a.h"
 #include "i2c.h"
 
-#define SI_CLK0_CONTROL 16      // Register definitions
+#define SI_OUTPUT_ENABLE 3      // Register definitions
+#define SI_CLK0_CONTROL 16
 #define SI_CLK1_CONTROL 17
 #define SI_CLK2_CONTROL 18
 #define SI_SYNTH_PLL_A  26
@@ -36,64 +38,221 @@
 // 1048575
 #define FRAC_DENOM 0xFFFFF
 
+// never equal to requested freq, forces full update
+#define FREQ_INVALID 0xFFFFFFFF
+
+// no ping-pong path on the pin
+#define PP_NONE 0xFF
+
 // for fast rdiv shift 
+#ifdef SI5351_LEAN
+static const uint8_t power2[8] PROGMEM = {1,2,4,8,16,32,64,128};
+#define POWER2(r) pgm_read_byte(&power2[r])
+#else
 uint8_t power2[8] = {1,2,4,8,16,32,64,128};
+#define POWER2(r) power2[r]
 
 uint32_t Si5351Base::VCOFreq_Max = 900000000;
 uint32_t Si5351Base::VCOFreq_Min = 600000000;
 uint32_t Si5351Base::VCOFreq_Mid = 750000000;
+#endif
 
+#ifndef SI5351_LEAN
 bool Si5351::_i2c_begin_write(uint8_t addr)
 {
   return i2c_begin_write(addr);
 }
 
-void Si5351::_i2c_end()
+bool Si5351::_i2c_end()
 {
-  i2c_end();
+  return i2c_end();
 }
 
 bool Si5351::_i2c_write(uint8_t data)
 {
   return i2c_write(data);
 }
+#endif
 
+#ifndef SI5351_NO_SOFT_I2C
 bool Si5351Soft::_i2c_begin_write(uint8_t addr)
 {
   return i2c.i2c_begin_write(addr);
 }
 
-void Si5351Soft::_i2c_end()
+bool Si5351Soft::_i2c_end()
 {
-  i2c.i2c_end();
+  return i2c.i2c_end();
 }
 
 bool Si5351Soft::_i2c_write(uint8_t data)
 {
-  return i2c_write(data);
+  return i2c.i2c_write(data);
+}
+#endif
+
+#ifndef SI5351_LEAN
+Si5351Queued::Si5351Queued(I2CQueue& q): Si5351Base(), queue(q)
+{
+  for (uint8_t i=0; i < SI5351_QUEUE_DEPTH; i++) {
+    xfer[i].data = buf[i];
+    xfer[i].done = 0;
+    xfer[i].status = I2C_XFER_IDLE;
+    xfer[i].next = 0;
+  }
+  cur = 0;
+  nak = false;
+}
+
+bool Si5351Queued::flush()
+{
+  while (queue.busy()) ;
+  for (uint8_t i=0; i < SI5351_QUEUE_DEPTH; i++) {
+    if (xfer[i].status == I2C_XFER_NAK) nak = true;
+    xfer[i].status = I2C_XFER_IDLE;
+  }
+  bool ok = !nak;
+  nak = false;
+  return ok;
+}
+
+bool Si5351Queued::_i2c_begin_write(uint8_t addr)
+{
+  I2CXfer& x = xfer[cur];
+  // slot is reused round robin, wait while it is in flight
+  while (x.status == I2C_XFER_QUEUED || x.status == I2C_XFER_ACTIVE) ;
+  for (uint8_t i=0; i < SI5351_QUEUE_DEPTH; i++) {
+    if (xfer[i].status == I2C_XFER_NAK) {
+      xfer[i].status = I2C_XFER_IDLE;
+      nak = true;
+      // earlier burst is lost, retry of this one does not help
+      set_bus_error();
+    }
+  }
+  x.status = I2C_XFER_IDLE;
+  x.addr = addr;
+  x.len = 0;
+  return true;
+}
+
+bool Si5351Queued::_i2c_end()
+{
+  I2CXfer& x = xfer[cur];
+  if (!x.len) return true;
+  queue.submit(&x);
+  if (++cur >= SI5351_QUEUE_DEPTH) cur = 0;
+  return true;
+}
+
+bool Si5351Queued::_i2c_write(uint8_t data)
+{
+  I2CXfer& x = xfer[cur];
+  if (x.len >= sizeof(buf[0])) return false;
+  buf[cur][x.len++] = data;
+  return true;
+}
+#endif
+
+// abort on first NAK (buffering backend finds it in _i2c_end),
+// retry whole burst retry_count times.
+// after failure all next bursts are skipped until begin_tune
+bool Si5351Base::si5351_write_burst(const uint8_t* data, uint8_t len)
+{
+  if (bus_error) return false;
+  uint16_t backoff = retry_backoff_us;
+  for (uint8_t attempt=0; ; attempt++) {
+    I2C_STAT(uint32_t t = micros());
+    uint8_t sent = 0;
+    bool ok = _i2c_begin_write(SI5351_I2C_ADDR);
+    while (ok && sent < len)
+      ok = _i2c_write(data[sent++]);
+    if (!_i2c_end()) ok = false;
+#ifdef I2C_STATS
+    stats.bus_us += micros() - t;
+    stats.transactions++;
+    stats.bytes += sent;
+    if (!ok) stats.naks++;
+    if (trace) trace(SI5351_I2C_ADDR, data, sent, ok ? I2C_TRACE_WRITE : I2C_TRACE_NAK);
+#endif
+    if (ok) return true;
+    if (attempt >= retry_count) break;
+    delayMicroseconds(backoff);
+    if (backoff < 0x8000) backoff <<= 1;
+  }
+  bus_error = true;
+  return false;
+}
+
+// 8 byte PLL or multisynth block, data[0] - first register.
+// only the span that differs from the last written image goes to the bus
+bool Si5351Base::si5351_write_synth(uint8_t* data)
+{
+  uint8_t idx = (data[0] - SI_SYNTH_PLL_A) >> 3;
+  uint8_t* img = shadow[idx];
+  uint8_t first = 0, last = 7;
+  if (shadow_valid & (1 << idx)) {
+    while (first < 8 && data[first+1] == img[first]) first++;
+    if (first == 8) return true;
+    while (data[last+1] == img[last]) last--;
+  }
+  // register address goes in front of the first changed byte
+  uint8_t save = data[first];
+  data[first] = data[0] + first;
+  bool ok = si5351_write_burst(data + first, last - first + 2);
+  data[first] = save;
+  if (ok) {
+    memcpy(img, data+1, 8);
+    shadow_valid |= 1 << idx;
+  } else
+    shadow_valid &= ~(1 << idx);
+  return ok;
+}
+
+void Si5351Base::set_retry(uint8_t count, uint16_t backoff_us)
+{
+  retry_count = count;
+  retry_backoff_us = backoff_us;
 }
 
 void Si5351Base::si5351_write_reg(uint8_t reg, uint8_t data)
 {
-  _i2c_begin_write(SI5351_I2C_ADDR);
-  _i2c_write(reg);
-  _i2c_write(data);
-  _i2c_end();
+  uint8_t buf[2] = {reg, data};
+  si5351_write_burst(buf, 2);
+}
+
+// CLKx_CONTROL, written only when it differs from the last written value.
+// shadow_valid bits 5..7 belong to CLK0..CLK2
+void Si5351Base::write_control(uint8_t clk_num, uint8_t value)
+{
+  uint8_t bit = 0x20 << clk_num;
+  if ((shadow_valid & bit) && clk_control[clk_num] == value) return;
+  uint8_t buf[2] = {(uint8_t)(SI_CLK0_CONTROL + clk_num), value};
+  if (si5351_write_burst(buf, 2)) {
+    clk_control[clk_num] = value;
+    shadow_valid |= bit;
+  } else
+    shadow_valid &= ~bit;
+}
+
+// 8 bytes of PLL or multisynth parameters
+static void si5351_pack_regs(uint8_t* buf, uint32_t P1, uint32_t P2, uint32_t P3, uint8_t rDiv, bool divby4)
+{
+  buf[0] = ((uint8_t*)&P3)[1];
+  buf[1] = (uint8_t)P3;
+  buf[2] = (((uint8_t*)&P1)[2] & 0x3) | rDiv | (divby4 ? 0x0C : 0x00);
+  buf[3] = ((uint8_t*)&P1)[1];
+  buf[4] = (uint8_t)P1;
+  buf[5] = ((P3 & 0x000F0000) >> 12) | ((P2 & 0x000F0000) >> 16);
+  buf[6] = ((uint8_t*)&P2)[1];
+  buf[7] = (uint8_t)P2;
 }
 
 void Si5351Base::si5351_write_regs(uint8_t synth, uint32_t P1, uint32_t P2, uint32_t P3, uint8_t rDiv, bool divby4)
 {
-  _i2c_begin_write(SI5351_I2C_ADDR);
-  _i2c_write(synth);
-  _i2c_write(((uint8_t*)&P3)[1]);
-  _i2c_write((uint8_t)P3);
-  _i2c_write((((uint8_t*)&P1)[2] & 0x3) | rDiv | (divby4 ? 0x0C : 0x00));
-  _i2c_write(((uint8_t*)&P1)[1]);
-  _i2c_write((uint8_t)P1);
-  _i2c_write(((P3 & 0x000F0000) >> 12) | ((P2 & 0x000F0000) >> 16));
-  _i2c_write(((uint8_t*)&P2)[1]);
-  _i2c_write((uint8_t)P2);
-  _i2c_end();
+  uint8_t buf[9];
+  buf[0] = synth;
+  si5351_pack_regs(buf+1, P1, P2, P3, rDiv, divby4);
+  si5351_write_synth(buf);
 }
 
 // Set up MultiSynth with mult, num and denom
@@ -131,14 +290,14 @@ void Si5351Base::si5351_setup_msynth_int(uint8_t synth, uint32_t divider, uint8_
   );
 }
 
-void Si5351Base::si5351_setup_msynth(uint8_t synth, uint32_t pll_freq)
+void Si5351Base::si5351_calc_pll(uint8_t* buf, uint32_t pll_freq)
 {
   uint8_t a = pll_freq / xtal_freq;
   uint32_t b = (pll_freq % xtal_freq) >> 5;
   uint32_t c = xtal_freq >> 5;
   uint32_t t = 128*b / c;
-  si5351_write_regs(
-    synth,
+  si5351_pack_regs(
+    buf,
     (uint32_t)(128 * (uint32_t)(a) + t - 512),
     (uint32_t)(128 * b - c * t),
     c,
@@ -147,41 +306,175 @@ void Si5351Base::si5351_setup_msynth(uint8_t synth, uint32_t pll_freq)
   );
 }
 
+void Si5351Base::si5351_setup_msynth(uint8_t synth, uint32_t pll_freq)
+{
+  uint8_t buf[9];
+  if (synth == SI_SYNTH_PLL_A) freq_pll_a = pll_freq;
+  else freq_pll_b = pll_freq;
+  buf[0] = synth;
+  si5351_calc_pll(buf+1, pll_freq);
+  si5351_write_synth(buf);
+}
+
 void Si5351Base::setup(uint8_t power0, uint8_t power1, uint8_t power2)
 {
-  power[0] = power0;
-  power[1] = power1;
-  power[2] = power2;
-  si5351_write_reg(SI_CLK0_CONTROL, 0x80);
-  si5351_write_reg(SI_CLK1_CONTROL, 0x80);
-  si5351_write_reg(SI_CLK2_CONTROL, 0x80);
-  VCOFreq_Mid = (VCOFreq_Min+VCOFreq_Max) >> 1;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_SETUP, 3, power0, power1, power2));
+  bus_error = false;
+  shadow_valid = 0;
+  pending_reset = 0;
+#ifndef SI5351_NO_PINGPONG
+  pp_clk = 0;
+#endif
+#ifndef SI5351_NO_MODULATION
+  mod_synth = 0;
+#endif
+  out[0].power = power0;
+  out[1].power = power1;
+  out[2].power = power2;
+  write_control(0, 0x80);
+  write_control(1, 0x80);
+  write_control(2, 0x80);
+#ifndef SI5351_LEAN
+  // shared by all instances, store only on change
+  uint32_t mid = (VCOFreq_Min+VCOFreq_Max) >> 1;
+  if (VCOFreq_Mid != mid) VCOFreq_Mid = mid;
+#endif
 }
 
 void Si5351Base::set_power(uint8_t clk_num, uint8_t value)
 {
-  power[clk_num] = value;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_POWER, 2, clk_num, value));
+  out[clk_num].power = value;
   // for force update
   freq[clk_num] = 0; 
-  freq_div[clk_num] = 0;
+  out[clk_num].div = 0;
 }
 
 void Si5351Base::set_power(uint8_t power1, uint8_t power2, uint8_t power3)
 {
   set_power(0,power1);
-  set_power(0,power2);
-  set_power(0,power3);
+  set_power(1,power2);
+  set_power(2,power3);
 }
 
 void Si5351Base::set_xtal_freq(uint32_t freq)
 {
-  xtal_freq = freq;
-  freq_div[0] = freq_div[1] = freq_div[2] = freq_rdiv[0] = freq_rdiv[1] = freq_rdiv[2] = 0;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_XTAL, 1, freq));
+  xtal_freq = xtal_nominal = freq;
+  out[0].div = out[1].div = out[2].div = out[0].rdiv = out[1].rdiv = out[2].rdiv = 0;
 }
 
-uint8_t Si5351Base::set_freq(uint32_t f0, uint32_t f1, uint32_t f2)
+uint8_t Si5351Base::correct_ppb(int32_t ppb)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_PPB, 1, ppb));
+  xtal_freq = xtal_nominal + (int32_t)((int64_t)xtal_nominal * ppb / 1000000000);
+  // same PLL freq from corrected xtal, only a/b/c change.
+  // multisynth untouched, no PLL reset
+  begin_tune();
+  if (out[0].div && freq_pll_a)
+    si5351_setup_msynth(SI_SYNTH_PLL_A, freq_pll_a);
+  if ((out[1].div || out[2].div) && freq_pll_b)
+    si5351_setup_msynth(SI_SYNTH_PLL_B, freq_pll_b);
+  return end_tune();
+}
+
+void Si5351Base::begin_tune()
 {
   need_reset_pll = 0;
+  bus_error = false;
+#ifndef SI5351_NO_MODULATION
+  mod_synth = 0;
+#endif
+#ifdef I2C_STATS
+  tune_start = micros();
+  tune_bus = stats.bus_us;
+  tune_trans = stats.transactions;
+#endif
+}
+
+uint8_t Si5351Base::end_tune()
+{
+  uint8_t reset = need_reset_pll;
+  if (reset_defer_ms && (reset | pending_reset)) {
+    // any tune restarts quiet interval
+    pending_reset |= reset;
+    reset_last = millis();
+    reset = 0;
+  }
+  if (reset) 
+    si5351_write_reg(SI_PLL_RESET, reset);
+  if (bus_error) {
+    forget_state();
+    return SI5351_BUS_ERROR;
+  }
+#ifdef I2C_STATS
+  if (reset) stats.pll_resets++;
+  if (need_reset_pll)
+    stats.slow_tunes++;
+  else if (stats.transactions != tune_trans)
+    stats.fast_tunes++;
+  stats.compute_us += (micros() - tune_start) - (stats.bus_us - tune_bus);
+#endif
+  // deferred reset is reported by poll()/flush_reset()
+  return reset;
+}
+
+// chip state is unknown, rewrite everything on next call
+void Si5351Base::forget_state()
+{
+  for (uint8_t i=0; i < 3; i++) {
+    freq[i] = FREQ_INVALID;
+    out[i].div = 0;
+  }
+  out_enable = SI5351_OUT_UNKNOWN;
+  shadow_valid = 0;
+  // next tune sets new dividers and asks for reset again
+  pending_reset = 0;
+}
+
+void Si5351Base::set_reset_defer(uint16_t quiet_ms)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_RESET_DEFER, 1, quiet_ms));
+  reset_defer_ms = quiet_ms;
+  if (!quiet_ms) write_pending_reset();
+}
+
+uint8_t Si5351Base::poll()
+{
+  if (!pending_reset || millis() - reset_last < reset_defer_ms) return 0;
+  return flush_reset();
+}
+
+uint8_t Si5351Base::flush_reset()
+{
+  // poll() comes here only with reset to write, so idle polls are not recorded
+  if (!pending_reset) return 0;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_FLUSH_RESET, 0));
+  return write_pending_reset();
+}
+
+uint8_t Si5351Base::write_pending_reset()
+{
+  uint8_t reset = pending_reset;
+  if (!reset) return 0;
+  pending_reset = 0;
+  bus_error = false;
+  si5351_write_reg(SI_PLL_RESET, reset);
+  if (bus_error) {
+    forget_state();
+    return SI5351_BUS_ERROR;
+  }
+  I2C_STAT(stats.pll_resets++);
+  return reset;
+}
+
+#ifndef SI5351_NO_CLK2_FRAC
+uint8_t Si5351Base::set_freq(uint32_t f0, uint32_t f1, uint32_t f2)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_FREQ, 3, f0, f1, f2));
+  f0 = snap(f0);
+  begin_tune();
+  pingpong_off();
   uint8_t freq1_changed = f1 != freq[1];
   if (f0 != freq[0]) {
     freq[0] = f0;
@@ -192,14 +485,16 @@ uint8_t Si5351Base::set_freq(uint32_t f0, uint32_t f1, uint32_t f2)
     freq[2] = f2;
     update_freq12(freq1_changed);
   }
-  if (need_reset_pll) 
-    si5351_write_reg(SI_PLL_RESET, need_reset_pll);
-  return need_reset_pll;
+  return end_tune();
 }
+#endif
 
 uint8_t Si5351Base::set_freq(uint32_t f0, uint32_t f1)
 {
-  need_reset_pll = 0;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_FREQ, 2, f0, f1));
+  f0 = snap(f0);
+  begin_tune();
+  pingpong_off();
   if (f0 != freq[0]) {
     freq[0] = f0;
     update_freq(0);
@@ -208,39 +503,266 @@ uint8_t Si5351Base::set_freq(uint32_t f0, uint32_t f1)
     freq[1] = f1;
     update_freq(1);
   }
-  if (need_reset_pll) 
-    si5351_write_reg(SI_PLL_RESET, need_reset_pll);
-  return need_reset_pll;
+  return end_tune();
 }
 
 uint8_t Si5351Base::set_freq(uint32_t f0)
 {
-  need_reset_pll = 0;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_FREQ, 1, f0));
+  f0 = snap(f0);
+  begin_tune();
+  pingpong_off();
   if (f0 != freq[0]) {
     freq[0] = f0;
     update_freq(0);
   }
-  if (need_reset_pll) 
-    si5351_write_reg(SI_PLL_RESET, need_reset_pll);
-  return need_reset_pll;
+  return end_tune();
+}
+
+uint8_t Si5351Base::apply_plan(const Si5351Plan* plan)
+{
+  Si5351Plan p;
+  memcpy_P(&p, plan, sizeof(p));
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_PLAN, 3, p.clk_num | (p.control & 0x03) << 8, p.freq, p.xtal));
+  begin_tune();
+  pingpong_off();
+  si5351_write_synth(p.pll);
+  si5351_write_synth(p.ms);
+  write_control(p.clk_num, p.control);
+  freq[p.clk_num] = p.freq;
+  out[p.clk_num].div = p.divider;
+  out[p.clk_num].rdiv = p.rdiv;
+  out[p.clk_num].power = p.control & 0x03;
+  if (p.clk_num) freq_pll_b = p.pll_freq;
+  else freq_pll_a = p.pll_freq;
+  need_reset_pll = p.clk_num ? SI_PLL_RESET_B : SI_PLL_RESET_A;
+  return end_tune();
+}
+
+// any other tune ends ping-pong mode. pin may run from MS0 and CLK0 pin
+// is gated, so pin and CLK0 are disabled and rewritten by the caller.
+// set_outputs mask is restored
+void Si5351Base::pingpong_off()
+{
+#ifndef SI5351_NO_PINGPONG
+  if (!pp_clk) return;
+  disable_out(pp_clk);
+  disable_out(0);
+  freq[pp_clk] = 0;
+  freq[0] = FREQ_INVALID;
+  pp_clk = 0;
+  write_outputs(user_outputs);
+#endif
 }
 
 void Si5351Base::disable_out(uint8_t clk_num)
 {
- si5351_write_reg(SI_CLK0_CONTROL+clk_num, 0x80);
- freq_div[clk_num] = 0;
+ write_control(clk_num, 0x80);
+ out[clk_num].div = 0;
+}
+
+bool Si5351Base::set_outputs(uint8_t mask)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_OUTPUTS, 1, mask));
+  bus_error = false;
+  user_outputs = mask & SI5351_OUT_ALL;
+#ifndef SI5351_NO_PINGPONG
+  // CLK0 and other pin stay gated in ping-pong mode
+  if (pp_clk) mask &= 1 << pp_clk;
+#endif
+  return write_outputs(mask);
+}
+
+bool Si5351Base::write_outputs(uint8_t mask)
+{
+  mask &= 0x07;
+  if (mask == out_enable) return true;
+  // register bit = 1 disables output
+  uint8_t buf[2] = {SI_OUTPUT_ENABLE, (uint8_t)~mask};
+  if (!si5351_write_burst(buf, 2)) {
+    out_enable = SI5351_OUT_UNKNOWN;
+    return false;
+  }
+  out_enable = mask;
+  return true;
+}
+
+void Si5351Base::set_tuning_quantum(uint32_t hz)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_QUANTUM, 1, hz));
+  quantum = hz ? hz : 1;
+}
+
+uint32_t Si5351Base::snap(uint32_t f)
+{
+  if (quantum <= 1 || !f) return f;
+  uint32_t q = (f + (quantum >> 1)) / quantum * quantum;
+  // 0 disables output, nonzero request stays on
+  return q ? q : quantum;
+}
+
+#ifndef SI5351_NO_MODULATION
+bool Si5351Base::mod_begin(uint8_t clk_num, uint32_t deviation)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_MOD_BEGIN, 2, clk_num, deviation));
+  mod_synth = 0;
+  // div 1 is fractional CLK2
+  if (clk_num > 2 || out[clk_num].div < 4 || freq[clk_num] == FREQ_INVALID) return false;
+  uint32_t pll_freq = clk_num ? freq_pll_b : freq_pll_a;
+  if (!pll_freq) return false;
+  // same a/b/c as si5351_calc_pll
+  uint8_t a = pll_freq / xtal_freq;
+  uint32_t b = (pll_freq % xtal_freq) >> 5;
+  mod_c = xtal_freq >> 5;
+  uint32_t t = 128*b / mod_c;
+  mod_p1 = 128 * (uint32_t)a + t - 512;
+  mod_p2 = 128 * b - mod_c * t;
+  // one P2 unit is xtal/(128*c) Hz of VCO, VCO deviation is output one * total divider
+  uint64_t units = (uint64_t)deviation * ((uint32_t)out[clk_num].div << out[clk_num].rdiv) * 128 * mod_c / xtal_freq;
+  units = (units << 8) / 127;
+  if (units > 0x7FFFFFFF / 128) return false;
+  mod_step = units;
+  mod_synth = clk_num ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A;
+
+  // longest diff against previous sample: from first byte that differs
+  // anywhere in sample range up to P2 low byte
+  uint32_t p1_lo, p2_lo, p1_hi, p2_hi;
+  mod_calc(-128, &p1_lo, &p2_lo);
+  mod_calc(127, &p1_hi, &p2_hi);
+  if (p1_lo != p1_hi) {
+    p2_lo = 0;
+    p2_hi = 0xFFFFF;
+  } else {
+    p1_lo = p1_hi = 0;
+  }
+  if ((p1_lo ^ p1_hi) >> 16) mod_bytes = 6;
+  else if ((p1_lo ^ p1_hi) >> 8) mod_bytes = 5;
+  else if (p1_lo ^ p1_hi) mod_bytes = 4;
+  else if ((p2_lo ^ p2_hi) >> 16) mod_bytes = 3;
+  else if ((p2_lo ^ p2_hi) >> 8) mod_bytes = 2;
+  else mod_bytes = 1;
+  return true;
+}
+
+void Si5351Base::mod_calc(int8_t sample, uint32_t* p1, uint32_t* p2)
+{
+  int32_t p = (int32_t)mod_p2 + (((int32_t)sample * (int32_t)mod_step) >> 8);
+  uint32_t q = mod_p1;
+  // carry into P1, few steps even for wide deviation
+  while (p < 0) {
+    p += mod_c;
+    q--;
+  }
+  while ((uint32_t)p >= mod_c) {
+    p -= mod_c;
+    q++;
+  }
+  *p1 = q;
+  *p2 = p;
+}
+
+bool Si5351Base::mod_sample(int8_t sample)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_MOD_SAMPLE, 1, sample));
+  return mod_write(sample);
+}
+
+bool Si5351Base::mod_write(int8_t sample)
+{
+  if (!mod_synth) return false;
+  uint8_t buf[9];
+  uint32_t p1, p2;
+  mod_calc(sample, &p1, &p2);
+  buf[0] = mod_synth;
+  si5351_pack_regs(buf+1, p1, p2, mod_c, 0, false);
+  // lost sample only invalidates shadow, next one rewrites whole block
+  bus_error = false;
+  return si5351_write_synth(buf);
+}
+
+uint16_t Si5351Base::mod_play(const int8_t* samples, uint16_t count, uint32_t rate_hz)
+{
+  if (!mod_synth || !rate_hz) return 0;
+  uint32_t period = 1000000 / rate_hz;
+  uint32_t rem = 1000000 % rate_hz, acc = 0;
+  uint16_t ok = 0;
+  uint32_t t = micros();
+  for (uint16_t i=0; i < count; i++) {
+    if (mod_sample(samples[i])) ok++;
+    // fractional period accumulates, no drift against rate_hz
+    t += period;
+    acc += rem;
+    if (acc >= rate_hz) {
+      acc -= rate_hz;
+      t++;
+    }
+    int32_t wait;
+    while ((wait = (int32_t)(t - micros())) > 0)
+      delayMicroseconds(wait > 10000 ? 10000 : wait);
+  }
+  return ok;
+}
+
+void Si5351Base::mod_end()
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_MOD_END, 0));
+  if (!mod_synth) return;
+  mod_write(0);
+  mod_synth = 0;
+}
+
+uint32_t Si5351Base::mod_max_rate(uint32_t scl_hz)
+{
+  if (!mod_synth) return 0;
+  // address, register, data
+  return scl_hz / (9 * (mod_bytes + 2) + 2);
+}
+#endif
+
+// out[]/freq[] index that drives clk_num pin, PP_NONE - pin is off
+uint8_t Si5351Base::pin_path(uint8_t clk_num)
+{
+#ifndef SI5351_NO_PINGPONG
+  if (pp_clk) {
+    if (clk_num == pp_clk) return pp_active;
+    // CLK0 pin is gated, MS0 belongs to ping-pong
+    if (!clk_num) return PP_NONE;
+  }
+#endif
+  return clk_num;
+}
+
+uint32_t Si5351Base::resolution(uint8_t clk_num)
+{
+  clk_num = pin_path(clk_num);
+  if (clk_num > 2 || !out[clk_num].div || freq[clk_num] == FREQ_INVALID) return 0;
+#ifndef SI5351_NO_CLK2_FRAC
+  if (clk_num == 2 && out[2].div == 1) {
+    // fractional multisynth from fixed PLL_B: step ~ f^2 * R / (PLL_B * c)
+    uint64_t f = freq[2];
+    uint32_t r = (uint32_t)((f * f * 1000 << out[2].rdiv) / ((uint64_t)freq_pll_b * frac_denom));
+    return r ? r : 1;
+  }
+#endif
+  // PLL b/c are xtal/32 based, so PLL step is 32 Hz
+  uint32_t d = (uint32_t)out[clk_num].div << out[clk_num].rdiv;
+  return (32000 + d - 1) / d;
 }
 
 uint8_t Si5351Base::is_freq_ok(uint8_t clk_num)
 {
- return freq_div[clk_num] != 0;
+ clk_num = pin_path(clk_num);
+ return clk_num <= 2 && out[clk_num].div != 0;
 }
 
 void Si5351Base::out_calibrate_freq()
 {
-  si5351_write_reg(SI_CLK0_CONTROL, power[0]);
-  si5351_write_reg(SI_CLK1_CONTROL, power[1]);
-  si5351_write_reg(SI_CLK2_CONTROL, power[2]);
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_CALIBRATE, 0));
+  bus_error = false;
+  shadow_valid = 0;
+  write_control(0, out[0].power);
+  write_control(1, out[1].power);
+  write_control(2, out[2].power);
   si5351_write_reg(SI_SYNTH_MS_0+2,0);
   si5351_write_reg(SI_SYNTH_MS_1+2,0);
   si5351_write_reg(SI_SYNTH_MS_2+2,0);
@@ -259,11 +781,28 @@ void Si5351Base::update_freq(uint8_t clk_num)
   }
 
   // try to use last divider
-  divider = freq_div[clk_num];
-  rdiv = freq_rdiv[clk_num];
-  pll_freq = divider * freq[clk_num] * power2[rdiv]; //(1 << rdiv);
-  
-  if (pll_freq < VCOFreq_Min || pll_freq > VCOFreq_Max) {
+  divider = out[clk_num].div;
+  rdiv = out[clk_num].rdiv;
+  pll_freq = divider * freq[clk_num] * POWER2(rdiv); //(1 << rdiv);
+  bool keep = pll_freq >= VCOFreq_Min && pll_freq <= VCOFreq_Max;
+
+#if SI5351_PLAN_CACHE
+  uint8_t idx = plan_find(freq[clk_num]);
+  if (idx < SI5351_PLAN_CACHE) {
+    // cached divider is used only when it does not cost extra PLL reset
+    uint16_t d = plan_cache[idx].div;
+    uint8_t r = plan_cache[idx].rdiv;
+    uint32_t f = d * freq[clk_num] * POWER2(r);
+    if (keep ? (d == divider && r == rdiv) : (f >= VCOFreq_Min && f <= VCOFreq_Max)) {
+      plan_promote(idx);
+      plan_hits++;
+      apply_freq(clk_num, d, r, plan_cache[idx].pll);
+      return;
+    }
+  }
+#endif
+
+  if (!keep) {
     divider = VCOFreq_Mid / freq[clk_num];
     if (divider < 4) 
     {
@@ -279,24 +818,230 @@ void Si5351Base::update_freq(uint8_t clk_num)
       rdiv++;
       divider >>= 1;
     }
+    if (rdiv > 7) {
+      disable_out(clk_num);
+      return;
+    }
     if (rdiv == 0) divider &= 0xFFFFFFFE;
-    pll_freq = divider * freq[clk_num] * power2[rdiv]; //(1 << rdiv);
   }
 
-  si5351_setup_msynth((clk_num ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A), pll_freq);
+#if SI5351_PLAN_CACHE
+  // only a new divider search is worth a slot, kept divider is PLL math only
+  if (!keep) {
+    uint8_t pll[8];
+    si5351_calc_pll(pll, divider * freq[clk_num] * POWER2(rdiv));
+    plan_misses++;
+    plan_store(freq[clk_num], divider, rdiv, pll);
+    apply_freq(clk_num, divider, rdiv, pll);
+    return;
+  }
+#endif
+  apply_freq(clk_num, divider, rdiv);
+}
+
+#if SI5351_PLAN_CACHE
+// index of cached plan, SI5351_PLAN_CACHE if not found. LRU order is not touched
+uint8_t Si5351Base::plan_find(uint32_t f)
+{
+  for (uint8_t i=0; i < plan_used; i++) {
+    uint8_t idx = plan_order[i];
+    if (plan_cache[idx].freq == f && plan_cache[idx].xtal == xtal_freq) return idx;
+  }
+  return SI5351_PLAN_CACHE;
+}
+
+// move used plan to front of LRU order
+void Si5351Base::plan_promote(uint8_t idx)
+{
+  uint8_t i = 0;
+  while (plan_order[i] != idx) i++;
+  for (; i > 0; i--) plan_order[i] = plan_order[i-1];
+  plan_order[0] = idx;
+}
+
+void Si5351Base::plan_store(uint32_t f, uint32_t divider, uint8_t rdiv, const uint8_t* pll)
+{
+  uint8_t idx = plan_find(f);
+  if (idx == SI5351_PLAN_CACHE) {
+    // new entry or least recently used one
+    uint8_t i = plan_used;
+    if (plan_used < SI5351_PLAN_CACHE) idx = plan_used++;
+    else idx = plan_order[--i];
+    for (; i > 0; i--) plan_order[i] = plan_order[i-1];
+    plan_order[0] = idx;
+  } else
+    plan_promote(idx);
+  plan_cache[idx].freq = f;
+  plan_cache[idx].xtal = xtal_freq;
+  plan_cache[idx].div = divider;
+  plan_cache[idx].rdiv = rdiv;
+  memcpy(plan_cache[idx].pll, pll, 8);
+}
+#endif
+
+// CLK0 - PLL_A, CLK1,CLK2 - PLL_B, multisynth integer
+void Si5351Base::apply_freq(uint8_t clk_num, uint32_t divider, uint8_t rdiv, const uint8_t* pll)
+{
+  uint32_t pll_freq = divider * freq[clk_num] * POWER2(rdiv); //(1 << rdiv);
+
+  if (pll) {
+    if (clk_num) freq_pll_b = pll_freq;
+    else freq_pll_a = pll_freq;
+    uint8_t buf[9];
+    buf[0] = clk_num ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A;
+    memcpy(buf+1, pll, 8);
+    si5351_write_synth(buf);
+  } else
+    si5351_setup_msynth((clk_num ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A), pll_freq);
 
-  if (divider != freq_div[clk_num] || rdiv != freq_rdiv[clk_num]) {
+  if (divider != out[clk_num].div || rdiv != out[clk_num].rdiv) {
     si5351_setup_msynth_int(SI_SYNTH_MS_0+clk_num*8, divider, R_DIV(rdiv));
-    si5351_write_reg(SI_CLK0_CONTROL+clk_num, 0x4C | power[clk_num] | (clk_num ? SI_CLK_SRC_PLL_B : SI_CLK_SRC_PLL_A));
-    freq_div[clk_num] = divider;
-    freq_rdiv[clk_num] = rdiv;
+    write_control(clk_num, 0x4C | out[clk_num].power | (clk_num ? SI_CLK_SRC_PLL_B : SI_CLK_SRC_PLL_A));
+    out[clk_num].div = divider;
+    out[clk_num].rdiv = rdiv;
     need_reset_pll |= (clk_num ? SI_PLL_RESET_B : SI_PLL_RESET_A);
   }
 }
 
+// divider for sweep from f in given direction
+// PLL starts from VCO edge so divider is valid for the longest part of sweep
+bool Si5351Base::sweep_divider(uint32_t f, bool up, uint32_t* divider, uint8_t* rdiv)
+{
+  uint32_t div = VCOFreq_Mid / f;
+  if (div < 4) return false;
+  if (div < 6) div = 4;
+  uint8_t r = 0;
+  while (div > 300) {
+    r++;
+    div >>= 1;
+  }
+  if (r > 7) return false;
+  if (r == 0) div &= 0xFFFFFFFE;
+
+  uint32_t ff = f << r;
+  uint32_t d = up ? (VCOFreq_Min + ff - 1) / ff : VCOFreq_Max / ff;
+  if (r == 0 && (d & 1)) {
+    if (up) d++;
+    else d--;
+  }
+  if (d >= 6 || (d == 4 && r == 0)) {
+    uint32_t pll_freq = d * ff;
+    if (pll_freq >= VCOFreq_Min && pll_freq <= VCOFreq_Max) div = d;
+  }
+  *divider = div;
+  *rdiv = r;
+  return true;
+}
+
+uint16_t Si5351Base::sweep_run(uint8_t clk_num, uint32_t start, int32_t step, const uint32_t* list, uint16_t count, SweepCallback dwell)
+{
+  uint8_t pll[9];
+  uint32_t f, fnext = 0, fmin = 0, fmax = 0;
+  uint32_t divider, pll_freq = 0;
+  uint8_t rdiv;
+  bool up = list ? (count < 2 || list[1] >= list[0]) : step >= 0;
+  bool fast = false;
+  uint16_t i;
+
+  if (clk_num > 2) return 0;
+  pll[0] = clk_num ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A;
+  f = list ? list[0] : start;
+  for (i=0; i < count; ) {
+    begin_tune();
+    pingpong_off();
+    freq[clk_num] = f;
+    if (fast) {
+      si5351_write_synth(pll);
+      if (clk_num) freq_pll_b = pll_freq;
+      else freq_pll_a = pll_freq;
+    } else if (f && sweep_divider(f, up, &divider, &rdiv)) {
+      apply_freq(clk_num, divider, rdiv);
+      // range of frequency for this divider
+      uint32_t d = divider << rdiv;
+      fmin = (VCOFreq_Min + d - 1) / d;
+      fmax = VCOFreq_Max / d;
+    } else {
+      disable_out(clk_num);
+      fmin = 1;
+      fmax = 0;
+    }
+    if (end_tune() & SI5351_BUS_ERROR) break;
+
+    // next point while current one settles
+    if (++i < count) {
+      fnext = list ? list[i] : start + (int32_t)i*step;
+      fast = fnext >= fmin && fnext <= fmax;
+      if (fast) {
+        pll_freq = out[clk_num].div * fnext * POWER2(out[clk_num].rdiv);
+        si5351_calc_pll(pll+1, pll_freq);
+      }
+    }
+    if (!dwell(i-1, f)) break;
+    f = fnext;
+  }
+  // replay needs the point where dwell or bus error ended the sweep
+  I2C_STAT(if (i < count) i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_SWEEP_STOP, 1, i));
+  return i;
+}
+
+uint16_t Si5351Base::sweep(uint8_t clk_num, uint32_t start, uint32_t stop, uint32_t step, SweepCallback dwell)
+{
+  uint32_t span = start < stop ? stop - start : start - stop;
+  uint32_t count = step ? span / step + 1 : 1;
+  // index and result are 16 bit, caller splits longer sweeps
+  if (count > 0xFFFF) return 0;
+  int32_t sstep = start < stop ? step : -(int32_t)step;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_SWEEP, 3, clk_num | count << 8, start, sstep));
+  return sweep_run(clk_num, start, sstep, 0, count, dwell);
+}
+
+uint16_t Si5351Base::sweep(uint8_t clk_num, const uint32_t* list, uint16_t count, SweepCallback dwell)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_SWEEP_LIST, 3, clk_num | (uint32_t)count << 8, count ? list[0] : 0, count ? list[count-1] : 0));
+  return sweep_run(clk_num, 0, 0, list, count, dwell);
+}
+
+#ifndef SI5351_NO_CLK2_FRAC
+// b/c with denominator <= FRAC_DENOM, 32-bit arithmetic only
+// exact if c/gcd(b,c) fits, else the best rational approximation
+static void frac_ratio(uint32_t* b, uint32_t* c)
+{
+  uint32_t p = *b, q = *c;
+  if (p == 0) {
+    *c = 1;
+    return;
+  }
+  // common case - exact as is
+  if (q <= FRAC_DENOM) return;
+
+  // continued fraction convergents h/k of p/q
+  uint32_t h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+  while (q) {
+    uint32_t a = p / q;
+    uint32_t r = p - a*q;
+    if (k1 && a > (FRAC_DENOM - k0) / k1) {
+      // denominator limit reached. semiconvergent is closer if t > a/2
+      uint32_t t = (FRAC_DENOM - k0) / k1;
+      if (2*t > a) {
+        h1 = t*h1 + h0;
+        k1 = t*k1 + k0;
+      }
+      break;
+    }
+    uint32_t h2 = a*h1 + h0;
+    uint32_t k2 = a*k1 + k0;
+    h0 = h1; h1 = h2;
+    k0 = k1; k1 = k2;
+    p = q;
+    q = r;
+  }
+  *b = h1;
+  *c = h1 ? k1 : 1;
+}
+
 void Si5351Base::update_freq12(uint8_t freq1_changed)
 {
-  uint32_t pll_freq,divider,num;
+  uint32_t pll_freq,divider,num,denom;
   uint8_t rdiv = 0;
 
   if (freq[1] == 0) {
@@ -310,9 +1055,9 @@ void Si5351Base::update_freq12(uint8_t freq1_changed)
   if (freq[1]) {
     if (freq1_changed) {
       // try to use last divider
-      divider = freq_div[1];
-      rdiv = freq_rdiv[1];
-      pll_freq = divider * freq[1] * power2[rdiv]; //(1 << rdiv);
+      divider = out[1].div;
+      rdiv = out[1].rdiv;
+      pll_freq = divider * freq[1] * POWER2(rdiv); //(1 << rdiv);
       
       if (pll_freq < VCOFreq_Min || pll_freq > VCOFreq_Max) {
         divider = VCOFreq_Mid / freq[1];
@@ -327,17 +1072,21 @@ void Si5351Base::update_freq12(uint8_t freq1_changed)
           rdiv++;
           divider >>= 1;
         }
+        if (rdiv > 7) {
+          disable_out(1);
+          return;
+        }
         if (rdiv == 0) divider &= 0xFFFFFFFE;
         
-        pll_freq = divider * freq[1] * power2[rdiv]; //(1 << rdiv);
+        pll_freq = divider * freq[1] * POWER2(rdiv); //(1 << rdiv);
       }
     
       si5351_setup_msynth(SI_SYNTH_PLL_B, pll_freq);
-      if (divider != freq_div[1] || rdiv != freq_rdiv[1]) {
+      if (divider != out[1].div || rdiv != out[1].rdiv) {
         si5351_setup_msynth_int(SI_SYNTH_MS_1, divider, R_DIV(rdiv));
-        si5351_write_reg(SI_CLK1_CONTROL, 0x4C | power[1] | SI_CLK_SRC_PLL_B);
-        freq_div[1] = divider;
-        freq_rdiv[1] = rdiv;
+        write_control(1, 0x4C | out[1].power | SI_CLK_SRC_PLL_B);
+        out[1].div = divider;
+        out[1].rdiv = rdiv;
         need_reset_pll |= SI_PLL_RESET_B;
       }
       freq_pll_b = pll_freq;
@@ -357,19 +1106,27 @@ void Si5351Base::update_freq12(uint8_t freq1_changed)
         ff <<= 1;
         divider >>= 1;
       }
+      if (rdiv > 7) {
+        disable_out(2);
+        return;
+      }
       divider = freq_pll_b / ff;
-      num = (uint64_t)(freq_pll_b % ff) * FRAC_DENOM / ff;
+      num = freq_pll_b % ff;
+      denom = ff;
+      frac_ratio(&num, &denom);
         
-      si5351_setup_msynth_abc(SI_SYNTH_MS_2,divider, num, (num?FRAC_DENOM:1), R_DIV(rdiv));
-      si5351_write_reg(SI_CLK2_CONTROL, (num?0x0C:0x4C) | power[2] | SI_CLK_SRC_PLL_B);
-      freq_div[2] = 1; // non zero for correct enable/disable CLK2
+      si5351_setup_msynth_abc(SI_SYNTH_MS_2,divider, num, denom, R_DIV(rdiv));
+      write_control(2, (num?0x0C:0x4C) | out[2].power | SI_CLK_SRC_PLL_B);
+      out[2].div = 1; // non zero for correct enable/disable CLK2
+      out[2].rdiv = rdiv;
+      frac_denom = denom;
     }
   } else if (freq[2]) {
     // PLL_B --> CLK2, multisynth integer
     // try to use last divider
-    divider = freq_div[2];
-    rdiv = freq_rdiv[2];
-    pll_freq = divider * freq[2] * power2[rdiv]; //(1 << rdiv);
+    divider = out[2].div;
+    rdiv = out[2].rdiv;
+    pll_freq = divider * freq[2] * POWER2(rdiv); //(1 << rdiv);
     
     if (pll_freq < VCOFreq_Min || pll_freq > VCOFreq_Max) {
       divider = VCOFreq_Mid / freq[2];
@@ -384,23 +1141,30 @@ void Si5351Base::update_freq12(uint8_t freq1_changed)
         rdiv++;
         divider >>= 1;
       }
+      if (rdiv > 7) {
+        disable_out(2);
+        return;
+      }
       if (rdiv == 0) divider &= 0xFFFFFFFE;
     
-      pll_freq = divider * freq[2] * power2[rdiv]; //(1 << rdiv);
+      pll_freq = divider * freq[2] * POWER2(rdiv); //(1 << rdiv);
     }
   
     si5351_setup_msynth(SI_SYNTH_PLL_B, pll_freq);
   
-    if (divider != freq_div[2] || rdiv != freq_rdiv[2]) {
+    if (divider != out[2].div || rdiv != out[2].rdiv) {
       si5351_setup_msynth_int(SI_SYNTH_MS_2, divider, R_DIV(rdiv));
-      si5351_write_reg(SI_CLK2_CONTROL, 0x4C | power[2] | SI_CLK_SRC_PLL_B);
-      freq_div[2] = divider;
-      freq_rdiv[2] = rdiv;
+      write_control(2, 0x4C | out[2].power | SI_CLK_SRC_PLL_B);
+      out[2].div = divider;
+      out[2].rdiv = rdiv;
       need_reset_pll |= SI_PLL_RESET_B;
     }
   }
 }
 
+#endif
+
+#ifndef SI5351_NO_QUADRATURE
 void Si5351Base::update_freq_quad(bool inverse_phase)
 {
   uint32_t pll_freq,divider;
@@ -435,22 +1199,25 @@ void Si5351Base::update_freq_quad(bool inverse_phase)
 
   si5351_setup_msynth(SI_SYNTH_PLL_A, pll_freq);
 
-  if (divider != freq_div[0]) {
+  if (divider != out[0].div) {
     uint8_t phase = divider & 0x7F;
     si5351_setup_msynth_int(SI_SYNTH_MS_0, divider, 0);
-    si5351_write_reg(SI_CLK0_CONTROL, 0x4C | power[0] | SI_CLK_SRC_PLL_A);
+    write_control(0, 0x4C | out[0].power | SI_CLK_SRC_PLL_A);
     si5351_write_reg(SI_CLK0_PHASE, (inverse_phase ? phase : 0));
     si5351_setup_msynth_int(SI_SYNTH_MS_1, divider, 0);
-    si5351_write_reg(SI_CLK1_CONTROL, 0x4C | power[0] | SI_CLK_SRC_PLL_A);
+    write_control(1, 0x4C | out[0].power | SI_CLK_SRC_PLL_A);
     si5351_write_reg(SI_CLK1_PHASE, (inverse_phase ? 0 : phase));
-    freq_div[0] = freq_div[1] = divider;
+    out[0].div = out[1].div = divider;
     need_reset_pll |= SI_PLL_RESET_A;
   }
 }
 
 uint8_t Si5351Base::set_freq_quadrature(uint32_t f01, uint32_t f2, bool inverse_phase)
 {
-  need_reset_pll = 0;
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_QUAD, 3, f01, f2, inverse_phase));
+  f01 = snap(f01);
+  begin_tune();
+  pingpong_off();
   if (f01 != freq[0]) {
     freq[0] = f01;
     update_freq_quad(inverse_phase);
@@ -459,7 +1226,96 @@ uint8_t Si5351Base::set_freq_quadrature(uint32_t f01, uint32_t f2, bool inverse_
     freq[2] = f2;
     update_freq(2);
   }
-  if (need_reset_pll) 
-    si5351_write_reg(SI_PLL_RESET, need_reset_pll);
-  return need_reset_pll;
+  return end_tune();
+}
+#endif
+
+#ifndef SI5351_NO_PINGPONG
+// CLK_SRC field of CLKx_CONTROL
+#define SI_CLK_SRC_MS0  0x08  // CLK1..CLK3 from MS0
+#define SI_CLK_SRC_MS   0x0C  // own multisynth
+
+// PLL and multisynth of one path, integer divider without R divider
+// (R divider belongs to the pin and is common for both paths)
+bool Si5351Base::pingpong_load(uint8_t path, uint32_t f)
+{
+  uint32_t divider = out[path].div;
+  uint32_t pll_freq = divider * f;
+  if (pll_freq < VCOFreq_Min || pll_freq > VCOFreq_Max) {
+    divider = VCOFreq_Mid / f;
+    if (divider < 4 || divider > 300) return false;
+    if (divider < 6) divider = 4;
+    divider &= 0xFFFFFFFE;
+    pll_freq = divider * f;
+  }
+  si5351_setup_msynth(path ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A, pll_freq);
+  if (divider != out[path].div) {
+    si5351_setup_msynth_int(SI_SYNTH_MS_0+path*8, divider, R_DIV(0));
+    // MS0 runs behind gated CLK0 pin
+    if (!path) write_control(0, 0x4C | out[pp_clk].power | SI_CLK_SRC_PLL_A);
+    out[path].div = divider;
+    out[path].rdiv = 0;
+    // path is not on the pin, so reset does not hurt output
+    si5351_write_reg(SI_PLL_RESET, path ? SI_PLL_RESET_B : SI_PLL_RESET_A);
+    I2C_STAT(stats.pll_resets++);
+  }
+  freq[path] = f;
+  return true;
+}
+
+uint8_t Si5351Base::set_freq_pingpong(uint8_t clk_num, uint32_t f)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_PINGPONG, 2, clk_num, f));
+  if (clk_num < 1 || clk_num > 2) return SI5351_BAD_ARG;
+  f = snap(f);
+  begin_tune();
+  if (clk_num != pp_clk) {
+    pp_clk = clk_num;
+    pp_active = PP_NONE;
+    disable_out(3 - clk_num);
+    freq[3 - clk_num] = 0;
+    out[0].div = out[clk_num].div = 0;
+    freq[0] = freq[clk_num] = FREQ_INVALID;
+  }
+  write_outputs(user_outputs & (1 << clk_num));
+  if (!f) {
+    if (pp_active != PP_NONE) disable_out(clk_num);
+    out[0].div = 0;
+    pp_active = PP_NONE;
+    return end_tune();
+  }
+  uint8_t a = pp_active;
+  if (a != PP_NONE && out[a].div) {
+    // PLL only update of path on the pin, no reset
+    uint32_t pll_freq = out[a].div * f;
+    if (pll_freq >= VCOFreq_Min && pll_freq <= VCOFreq_Max) {
+      if (f != freq[a]) si5351_setup_msynth(a ? SI_SYNTH_PLL_B : SI_SYNTH_PLL_A, pll_freq);
+      freq[a] = f;
+      return end_tune();
+    }
+  }
+  uint8_t i = a == clk_num ? 0 : clk_num;
+  if ((freq[i] != f || !out[i].div) && !pingpong_load(i, f)) {
+    // out of range
+    disable_out(clk_num);
+    out[0].div = 0;
+    pp_active = PP_NONE;
+    return end_tune();
+  }
+  // the only write on the pin path. MSx keeps its PLL_B setup
+  write_control(clk_num, 0x40 | SI_CLK_SRC_PLL_B | (i ? SI_CLK_SRC_MS : SI_CLK_SRC_MS0) | out[clk_num].power);
+  pp_active = i;
+  return end_tune();
+}
+
+uint8_t Si5351Base::prepare_pingpong(uint32_t f)
+{
+  I2C_STAT(i2c_trace_call(trace, SI5351_I2C_ADDR, I2C_CALL_PINGPONG_PREPARE, 1, f));
+  if (!pp_clk || !f) return 0;
+  f = snap(f);
+  begin_tune();
+  uint8_t i = pp_active == pp_clk ? 0 : pp_clk;
+  if (freq[i] != f || !out[i].div) pingpong_load(i, f);
+  return end_tune();
 }
+#endif
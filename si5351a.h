@@ -9,13 +9,30 @@
 #define SI5351A_H
 
 #include <inttypes.h>
+#include "si5351_config.h"
+#include "i2c.h"
+#include "i2c_stats.h"
+#include "i2c_queue.h"
+#ifndef SI5351_NO_SOFT_I2C
 #include "i2c_soft.h"
+#endif
 
 #define SI5351_CLK_DRIVE_2MA  0
 #define SI5351_CLK_DRIVE_4MA  1
 #define SI5351_CLK_DRIVE_6MA  2
 #define SI5351_CLK_DRIVE_8MA  3
 
+// set_freq result bits, PLL reset bits are 0x20 and 0x80
+#define SI5351_BUS_ERROR  0x01
+#define SI5351_BAD_ARG    0x02  // nothing written
+
+// set_outputs mask
+#define SI5351_OUT_CLK0   0x01
+#define SI5351_OUT_CLK1   0x02
+#define SI5351_OUT_CLK2   0x04
+#define SI5351_OUT_ALL    0x07
+#define SI5351_OUT_UNKNOWN 0xFF
+
 /*
  * Feequency plan:
  * CLK0 - PLL_A, multisynth integer
@@ -23,37 +40,153 @@
  * CLK2 - PLL_B, multisynth integer or fractional
  * if CLK1 == 0 --> CLK2 - PLL_B, multisynth integer
  */
+
+// precomputed register image for one output, see si5351_plan.h
+struct Si5351Plan {
+  uint32_t freq;
+  uint32_t pll_freq;
+  uint32_t xtal;  // xtal the plan was computed for
+  uint16_t divider;
+  uint8_t clk_num;
+  uint8_t rdiv;
+  uint8_t pll[9]; // first register + 8 bytes
+  uint8_t ms[9];
+  uint8_t control;
+};
  
 class Si5351Base {
+  public:
+    // return false for stop sweep
+    typedef bool (*SweepCallback)(uint16_t index, uint32_t freq);
   private:
-    uint16_t freq_div[3] = {0,0,0};
-    uint8_t freq_rdiv[3] = {0,0,0};
-    uint8_t power[3] = {SI5351_CLK_DRIVE_8MA,SI5351_CLK_DRIVE_8MA,SI5351_CLK_DRIVE_8MA};
+    struct {
+      uint16_t div:11;   // multisynth divider, 0 - out disabled
+      uint16_t rdiv:3;   // R divider, power of 2
+      uint16_t power:2;  // SI5351_CLK_DRIVE_xxx
+    } out[3];
     uint32_t freq[3] = {0,0,0};
-    uint32_t xtal_freq, freq_pll_b;
+    uint32_t xtal_freq, xtal_nominal, freq_pll_a, freq_pll_b;
     uint8_t need_reset_pll;
+    uint8_t pending_reset = 0;   // deferred SI_PLL_RESET bits
+    uint16_t reset_defer_ms = 0;
+    uint32_t reset_last;         // millis() of last tune while reset is pending
+    bool bus_error = false;
+    uint8_t out_enable = SI5351_OUT_UNKNOWN; // shadow of register 3
+    uint8_t user_outputs = SI5351_OUT_ALL;   // last set_outputs mask
+    uint8_t shadow[5][8];  // last written PLL_A, PLL_B, MS0, MS1, MS2
+    uint8_t clk_control[3];  // last written CLK0..CLK2_CONTROL
+    uint8_t shadow_valid = 0;  // bits 0..4 - synth blocks, 5..7 - clk_control
+    uint32_t quantum = 1;
+#ifndef SI5351_NO_CLK2_FRAC
+    uint32_t frac_denom = 1;  // c of fractional CLK2 multisynth
+#endif
+    uint8_t retry_count = 0;
+    uint16_t retry_backoff_us = 0;
+#ifdef I2C_STATS
+    uint32_t tune_start, tune_bus, tune_trans;
+#endif
+#if SI5351_PLAN_CACHE
+    struct {
+      uint32_t freq, xtal;  // key
+      uint16_t div;
+      uint8_t rdiv;
+      uint8_t pll[8];
+    } plan_cache[SI5351_PLAN_CACHE];
+    uint8_t plan_order[SI5351_PLAN_CACHE]; // most recent first
+    uint8_t plan_used = 0;
+    uint32_t plan_hits = 0, plan_misses = 0;
+    uint8_t plan_find(uint32_t f);
+    void plan_promote(uint8_t idx);
+    void plan_store(uint32_t f, uint32_t divider, uint8_t rdiv, const uint8_t* pll);
+#endif
+#ifndef SI5351_NO_PINGPONG
+    uint8_t pp_clk = 0;      // output pin, 0 - mode off
+    uint8_t pp_active;       // path on the pin: 0 - PLL_A/MS0, pp_clk - PLL_B/MSx
+    bool pingpong_load(uint8_t path, uint32_t f);
+#endif
+    void pingpong_off();
+    uint8_t pin_path(uint8_t clk_num);
+#ifndef SI5351_NO_MODULATION
+    uint8_t mod_synth = 0;   // PLL base register, 0 - off
+    uint8_t mod_bytes;       // worst case data bytes per sample
+    uint32_t mod_p1, mod_p2, mod_c;
+    uint32_t mod_step;       // P2 units per sample step, 8.8 fixed point
+    void mod_calc(int8_t sample, uint32_t* p1, uint32_t* p2);
+    bool mod_write(int8_t sample);
+#endif
 
+#ifndef SI5351_LEAN
     static uint32_t VCOFreq_Mid; 
+#endif
     
+    void begin_tune();
+    uint8_t end_tune();
+    void forget_state();
+    uint8_t write_pending_reset();
+    uint32_t snap(uint32_t f);
     void si5351_setup_msynth(uint8_t synth, uint32_t pll_freq);
+    void si5351_calc_pll(uint8_t* buf, uint32_t pll_freq);
+    bool sweep_divider(uint32_t f, bool up, uint32_t* divider, uint8_t* rdiv);
+    uint16_t sweep_run(uint8_t clk_num, uint32_t start, int32_t step, const uint32_t* list, uint16_t count, SweepCallback dwell);
     void update_freq(uint8_t clk_num);
+    // pll - 8 byte PLL image, 0 - compute
+    void apply_freq(uint8_t clk_num, uint32_t divider, uint8_t rdiv, const uint8_t* pll = 0);
+#ifndef SI5351_NO_CLK2_FRAC
     void update_freq12(uint8_t freq1_changed);
+#endif
+#ifndef SI5351_NO_QUADRATURE
     void update_freq_quad(bool inverse_phase);
+#endif
     void disable_out(uint8_t clk_num); // 0,1,2
+    // Output Enable write inside a tune, keeps bus_error of the tune
+    bool write_outputs(uint8_t mask);
     void set_control(uint8_t clk_num, uint8_t ctrl); // 0,1,2
     void si5351_setup_msynth_int(uint8_t synth, uint32_t divider, uint8_t rDiv);
     void si5351_setup_msynth_abc(uint8_t synth, uint8_t a, uint32_t b, uint32_t c, uint8_t rDiv);
     void si5351_write_regs(uint8_t synth, uint32_t P1, uint32_t P2, uint32_t P3, uint8_t rDiv, bool divby4);
     void si5351_write_reg(uint8_t reg, uint8_t data);
+    void write_control(uint8_t clk_num, uint8_t value);
+    // data[0] - first register
+    bool si5351_write_burst(const uint8_t* data, uint8_t len);
+    // data[0] - PLL or MS base register, data[1..8] - parameters
+    bool si5351_write_synth(uint8_t* data);
   protected:
+#ifdef SI5351_LEAN
+    // hardware bus only, no vtable
+    bool _i2c_begin_write(uint8_t addr) { return i2c_begin_write(addr); }
+    bool _i2c_end() { return i2c_end(); }
+    bool _i2c_write(uint8_t data) { return i2c_write(data); }
+  public:
+    static constexpr uint32_t VCOFreq_Max = 900000000;
+    static constexpr uint32_t VCOFreq_Min = 600000000;
+    static constexpr uint32_t VCOFreq_Mid = 750000000;
+#else
+    // failure found outside of current burst, tune ends with SI5351_BUS_ERROR
+    void set_bus_error() { bus_error = true; }
+    // backend: false from _i2c_begin_write/_i2c_write aborts burst at once,
+    // _i2c_end returns status of whole transaction (buffering backend sends
+    // it there). NAK found after _i2c_end is passed by set_bus_error
     virtual bool _i2c_begin_write(uint8_t addr) = 0;
-    virtual void _i2c_end() = 0;
+    virtual bool _i2c_end() = 0;
     virtual bool _i2c_write(uint8_t data) = 0;
   public:
     static uint32_t VCOFreq_Max; // == 900000000
     static uint32_t VCOFreq_Min; // == 600000000
+#endif
+
+#ifdef I2C_STATS
+    I2CStats stats = {};
+    I2CTraceHook trace = 0;
+#endif
 
-    Si5351Base() { xtal_freq=25000000; }
+    Si5351Base() {
+      xtal_freq=xtal_nominal=25000000;
+      freq_pll_a=freq_pll_b=0;
+      for (uint8_t i=0; i < 3; i++) {
+        out[i].div = out[i].rdiv = 0;
+        out[i].power = SI5351_CLK_DRIVE_8MA;
+      }
+    }
     
     // power 0=2mA, 1=4mA, 2=6mA, 3=8mA
     void setup(uint8_t power1 = 3, uint8_t power2 = 3, uint8_t power3 = 3);
@@ -67,39 +200,189 @@ class Si5351Base {
     
     // set xtal freq 
     void set_xtal_freq(uint32_t freq);
+
+    // xtal drift correction relative to set_xtal_freq value, in ppb.
+    // rewrite PLL fraction of active outputs only, no divider change
+    // and no PLL reset, so it can run periodically on air.
+    // return 0 or SI5351_BUS_ERROR
+    uint8_t correct_ppb(int32_t ppb);
+
+    // on NAK repeat burst up to count times, delay doubles from backoff_us
+    // default - no retry. needs NAK known before _i2c_end returns (TWI,
+    // SoftI2C, i2c_linux), no effect for Si5351Queued
+    void set_retry(uint8_t count, uint16_t backoff_us);
+
+    // PLL reset after divider change is collected and written once when
+    // no set_freq came for quiet_ms, by poll() from loop or by flush_reset().
+    // PLL and multisynth registers are still written at once. 0 - reset
+    // immediately (default), pending reset is flushed. while deferred
+    // set_freq returns 0 for held reset, see get_pending_reset()
+    void set_reset_defer(uint16_t quiet_ms);
+    // return written reset mask, 0 or SI5351_BUS_ERROR
+    uint8_t poll();
+    uint8_t flush_reset();
+    // SI_PLL_RESET bits waiting for poll()
+    uint8_t get_pending_reset() { return pending_reset; }
     
     // pass zero frequency for disable out
-    // return true if PLL was reset
+    // return PLL reset mask written by this call (0 if none or deferred)
+    // or SI5351_BUS_ERROR if chip not respond.
+    // on error all outputs are rewritten by next call
+#ifndef SI5351_NO_CLK2_FRAC
     uint8_t set_freq(uint32_t f0, uint32_t f1, uint32_t f2);
+#endif
     uint8_t set_freq(uint32_t f0, uint32_t f1);
     uint8_t set_freq(uint32_t f0);
     
+#ifndef SI5351_NO_QUADRATURE
     // CLK0,CLK1 in qudrature, CLK2 = f2
-    // return true if PLL was reset
+    // return reset PLL mask written now or SI5351_BUS_ERROR.
+    // phase is set by PLL reset: with set_reset_defer it is undefined
+    // until poll() or flush_reset() writes the held reset
     uint8_t set_freq_quadrature(uint32_t f01, uint32_t f2, bool inverse_phase = false);
+#endif
     
+#ifndef SI5351_NO_PINGPONG
+    // single output on CLK1 or CLK2 fed by two paths: PLL_A/MS0 and PLL_B/MSx.
+    // freq reachable by PLL only is tuned on current path. otherwise idle
+    // path is programmed and reset while the pin still runs, then pin source
+    // is switched by one CLKx_CONTROL write - no dropout on band change.
+    // previous freq stays on idle path, so A/B toggle is one write.
+    // CLK0 pin is gated off by Output Enable, other CLK1/CLK2 is disabled.
+    // 2.5 MHz and up (no R divider). is_freq_ok/resolution of clk_num
+    // follow the path on the pin. set_freq, set_freq_quadrature,
+    // apply_plan or sweep end the mode: pin is disabled, set_outputs mask
+    // is restored.
+    // return 0, SI5351_BUS_ERROR or SI5351_BAD_ARG if clk_num is not 1 or 2
+    uint8_t set_freq_pingpong(uint8_t clk_num, uint32_t freq);
+    // program idle path ahead, next set_freq_pingpong(freq) only switches
+    uint8_t prepare_pingpong(uint32_t freq);
+#endif
+
     // check that freq set corrected
     uint8_t is_freq_ok(uint8_t clk_num);
+
+    // gate outputs by Output Enable register, one byte write.
+    // mask bit set - CLKn on. frequency plan and PLL are not touched,
+    // use it for RX/TX switching instead of set_freq(0)
+    // return false on bus error. mask is kept by set_freq_pingpong, which
+    // enables only its pin out of it, and restored when ping-pong mode ends
+    bool set_outputs(uint8_t mask);
+    // SI5351_OUT_UNKNOWN before first set_outputs or after bus error
+    uint8_t get_outputs() { return out_enable; }
+
+    // round VFO freq (f0 of set_freq, f01 of set_freq_quadrature,
+    // set_freq_pingpong) to multiple of hz, so small encoder steps inside
+    // one quantum make no bus traffic. fixed BFO/IF outputs are exact.
+    // nonzero freq below hz/2 goes to hz, not to 0 (off). 0 or 1 - off
+    void set_tuning_quantum(uint32_t hz);
+
+    // output frequency step of current plan in mHz, 0 if out disabled.
+    // requests closer than that give the same registers and are not written.
+    // fractional CLK2 - step of numerator at current denominator
+    uint32_t resolution(uint8_t clk_num);
+
+    // false if last call got NAK
+    bool is_bus_ok() { return !bus_error; }
+
+#if SI5351_PLAN_CACHE
+    // LRU of computed plans keyed by freq and xtal. set_freq to recent freq
+    // takes divider and PLL image from cache, only diff goes to the bus.
+    // only tunes that needed a new divider are stored and counted as miss,
+    // small steps on the kept divider do not evict VFO A/B or memories.
+    // many misses on VFO A/B or memory recall - increase SI5351_PLAN_CACHE
+    uint32_t get_plan_hits() { return plan_hits; }
+    uint32_t get_plan_misses() { return plan_misses; }
+    void clear_plan_cache() { plan_used = 0; plan_hits = plan_misses = 0; }
+#endif
+
+#ifndef SI5351_NO_MODULATION
+    // FM by PLL numerator: multisynth and PLL a/c stay fixed, sample moves
+    // only P2 (with carry into P1), so each sample is a short diff burst.
+    // clk_num PLL is modulated: CLK0 - PLL_A, CLK1 and CLK2 share PLL_B.
+    // call after set_freq, integer multisynth plan only. deviation in Hz
+    // at sample +-127. set_freq, correct_ppb or setup ends modulation
+    bool mod_begin(uint8_t clk_num, uint32_t deviation);
+    // from timer ISR or loop at fixed rate, no division inside.
+    // from ISR it must not preempt any other call on this object or the
+    // shared I2C bus: stop the timer before set_freq, poll and friends
+    bool mod_sample(int8_t sample);
+    // buffered samples at rate_hz from loop, paced by micros(), no ISR.
+    // return number of samples written without bus error
+    uint16_t mod_play(const int8_t* samples, uint16_t count, uint32_t rate_hz);
+    // back to carrier
+    void mod_end();
+    // max samples per second for current mod_begin at scl_hz,
+    // bus time only: worst burst of 9 bits per byte plus START/STOP
+    uint32_t mod_max_rate(uint32_t scl_hz);
+#endif
+
+    // write precomputed plan from flash (PROGMEM), no divider or PLL math
+    // return reset PLL mask written now (0 if deferred) or SI5351_BUS_ERROR
+    uint8_t apply_plan(const Si5351Plan* plan);
+
+    // sweep one output: CLK0 - PLL_A, CLK1 or CLK2 - PLL_B, multisynth integer
+    // multisynth divider is kept while possible, so most points are PLL only update.
+    // registers of next point are computed right after current point is written,
+    // before dwell(index, freq) is called
+    // return number of passed points. 0 - nothing written: clk_num > 2 or
+    // more than 65535 points from start to stop
+    uint16_t sweep(uint8_t clk_num, uint32_t start, uint32_t stop, uint32_t step, SweepCallback dwell);
+    uint16_t sweep(uint8_t clk_num, const uint32_t* list, uint16_t count, SweepCallback dwell);
 };
 
 // si5351 на штатной I2C шине
+#ifdef SI5351_LEAN
+class Si5351: public Si5351Base {
+};
+#else
 class Si5351: public Si5351Base {
   protected:
     bool _i2c_begin_write(uint8_t addr);
-    void _i2c_end();
+    bool _i2c_end();
     bool _i2c_write(uint8_t data);
 };
+#endif
 
+#ifndef SI5351_NO_SOFT_I2C
 // si5351 на софтовой I2C шине
 class Si5351Soft: public Si5351Base {
   private:
     SoftI2C i2c;
   public:
-    Si5351Soft(uint8_t sda, uint8_t scl, bool internal_pullup = false): Si5351Base(), i2c(sda,scl,internal_pullup) { i2c.i2c_init(); }
+    // delay_us - half of SCL period
+    Si5351Soft(uint8_t sda, uint8_t scl, bool internal_pullup = false, uint16_t delay_us = 4): Si5351Base(), i2c(sda,scl,internal_pullup) { i2c.i2c_init(delay_us); }
   protected:
     bool _i2c_begin_write(uint8_t addr);
-    void _i2c_end();
+    bool _i2c_end();
     bool _i2c_write(uint8_t data);
 };
+#endif
+
+#ifndef SI5351_LEAN
+// si5351 на неблокирующей очереди (SoftI2CQueue и т.п.)
+// set_freq returns as soon as bursts are queued. NAK of queued burst is
+// found by next burst, so set_freq may return SI5351_BUS_ERROR one call late
+// (and next set_freq rewrites all registers). set_retry has no effect,
+// burst is already gone when its NAK is known
+class Si5351Queued: public Si5351Base {
+  private:
+    I2CQueue& queue;
+    I2CXfer xfer[SI5351_QUEUE_DEPTH];
+    uint8_t buf[SI5351_QUEUE_DEPTH][9];
+    uint8_t cur;
+    bool nak;
+  public:
+    Si5351Queued(I2CQueue& q);
+    // all queued bursts are on the wire
+    bool busy() { return queue.busy(); }
+    // wait for queue, return false if any burst was NAKed
+    bool flush();
+  protected:
+    bool _i2c_begin_write(uint8_t addr);
+    bool _i2c_end();
+    bool _i2c_write(uint8_t data);
+};
+#endif
 
 #endif
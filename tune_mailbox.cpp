@@ -0,0 +1,83 @@
+// latest-wins tuning mailbox
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+
+#include "tune_mailbox.h"
+
+void TuneMailbox::post(uint8_t count, uint32_t f0, uint32_t f1, uint32_t f2)
+{
+  // consumer cannot run inside producer, so reading is stable here.
+  // write the slot consumer does not own, overwrite of latest is fine
+  // when consumer is not reading it
+  uint8_t r = reading;
+  uint8_t idx = r != TUNE_MAILBOX_NONE ? r ^ 1 : latest ^ 1;
+  slot[idx].f[0] = f0;
+  slot[idx].f[1] = f1;
+  slot[idx].f[2] = f2;
+  slot[idx].count = count;
+  latest = idx;
+  if (pending) overwritten++;
+  pending = 1;
+}
+
+uint16_t TuneMailbox::get_overwritten()
+{
+  // 16 bit read is not atomic on AVR
+  uint16_t n;
+  do {
+    n = overwritten;
+  } while (n != overwritten);
+  return n;
+}
+
+uint8_t TuneMailbox::fetch(uint32_t* f)
+{
+  if (!pending) return 0;
+  // post after this point sets pending again and is fetched next time
+  pending = 0;
+  uint8_t idx = latest;
+  reading = idx;
+  // post between two lines above completes before we continue,
+  // so slot idx is consistent. post from now on writes the other slot
+  f[0] = slot[idx].f[0];
+  f[1] = slot[idx].f[1];
+  f[2] = slot[idx].f[2];
+  uint8_t count = slot[idx].count;
+  reading = TUNE_MAILBOX_NONE;
+  return count;
+}
+
+uint8_t TuneMailbox::service(Si5351Base& vfo)
+{
+  uint32_t f[3];
+  uint8_t res;
+  switch (fetch(f)) {
+    case 1:
+      res = vfo.set_freq(f[0]);
+      break;
+    case 2:
+      res = vfo.set_freq(f[0], f[1]);
+      break;
+#ifndef SI5351_NO_CLK2_FRAC
+    case 3:
+      res = vfo.set_freq(f[0], f[1], f[2]);
+      break;
+#endif
+    default:
+      return 0;
+  }
+  // retry on next call unless newer request arrived
+  if (res & SI5351_BUS_ERROR) pending = 1;
+  return res;
+}
+
+bool TuneMailbox::service(Si570& vfo)
+{
+  uint32_t f[3];
+  if (!fetch(f)) return false;
+  if (vfo.set_freq(f[0])) return true;
+  pending = 1;
+  return false;
+}
@@ -0,0 +1,61 @@
+// latest-wins tuning mailbox
+// encoder ISR posts target frequency, main loop writes only the newest one.
+// two slots, no locks: producer never writes the slot consumer is reading.
+// one producer context (ISR or main loop), one consumer (main loop)
+// (c) Andrew Bilokon, UR5FFR
+// mailto:ban.relayer@gmail.com
+// http://dspview.com
+// https://github.com/andrey-belokon
+//
+// usage:
+//   TuneMailbox mbox;
+//   ISR: mbox.post(freq);
+//   loop(): mbox.service(vfo);
+
+#ifndef TUNE_MAILBOX_H
+#define TUNE_MAILBOX_H
+
+#include <inttypes.h>
+#include "si5351a.h"
+#include "Si570.h"
+
+#define TUNE_MAILBOX_NONE 0xFF
+
+class TuneMailbox {
+  private:
+    struct {
+      uint32_t f[3];
+      uint8_t count;
+    } volatile slot[2];
+    volatile uint8_t latest;   // last complete slot
+    volatile uint8_t reading;  // slot copied by fetch or TUNE_MAILBOX_NONE
+    volatile uint8_t pending;
+    volatile uint16_t overwritten;
+
+    void post(uint8_t count, uint32_t f0, uint32_t f1, uint32_t f2);
+  public:
+    TuneMailbox(): latest(0), reading(TUNE_MAILBOX_NONE), pending(0), overwritten(0) {}
+
+    // producer side, ISR safe. replaces not yet applied request
+    void post(uint32_t f0) { post(1, f0, 0, 0); }
+    void post(uint32_t f0, uint32_t f1) { post(2, f0, f1, 0); }
+    void post(uint32_t f0, uint32_t f1, uint32_t f2) { post(3, f0, f1, f2); }
+
+    bool is_pending() { return pending; }
+    // requests replaced before they were applied
+    uint16_t get_overwritten();
+
+    // consumer side. copy newest request, return number of freqs or 0 if none
+    uint8_t fetch(uint32_t* f);
+
+    // apply newest request with set_freq(f0 [,f1 [,f2]]).
+    // return set_freq result or 0 if nothing pending.
+    // failed request stays pending and is retried by next call,
+    // unless newer one is posted
+    uint8_t service(Si5351Base& vfo);
+    // Si570 use f0 only. return false if nothing pending or set_freq failed
+    // (request stays pending as above)
+    bool service(Si570& vfo);
+};
+
+#endif